@@ -0,0 +1,648 @@
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "geometry.hpp"
+#include "reference.hpp"
+
+namespace {
+
+const int kRadius = 1 << 28;
+const int kQueries = 1 << 12;
+
+// Vertexes on a circle for convex polygons; for concave ones every other
+// vertex is pulled in to half the radius, which gives a star.
+std::vector<Geometry::Point> MakeVertexes(int vertexes, bool concave) {
+  std::vector<Geometry::Point> points;
+  points.reserve(vertexes);
+  for (int i = 0; i < vertexes; ++i) {
+    double angle = 2 * M_PI * i / vertexes;
+    double radius = concave && i % 2 == 1 ? kRadius / 2 : kRadius;
+    points.emplace_back(static_cast<int>(radius * std::cos(angle)),
+                        static_cast<int>(radius * std::sin(angle)));
+  }
+  return points;
+}
+
+const std::vector<Geometry::Point>& GetVertexes(int vertexes, bool concave) {
+  static std::map<std::pair<int, bool>, std::vector<Geometry::Point>> cache;
+  auto& result = cache[{vertexes, concave}];
+  if (result.empty()) {
+    result = MakeVertexes(vertexes, concave);
+  }
+  return result;
+}
+
+const Geometry::Polygon& GetPolygon(int vertexes, bool concave) {
+  static std::map<std::pair<int, bool>, std::unique_ptr<Geometry::Polygon>>
+      cache;
+  auto& result = cache[{vertexes, concave}];
+  if (!result) {
+    result.reset(new Geometry::Polygon(GetVertexes(vertexes, concave)));
+  }
+  return *result;
+}
+
+// The raster cache is built once per polygon, like the polygon itself.
+const Geometry::Polygon& GetCachedPolygon(int vertexes, bool concave) {
+  static std::map<std::pair<int, bool>, std::unique_ptr<Geometry::Polygon>>
+      cache;
+  auto& result = cache[{vertexes, concave}];
+  if (!result) {
+    result.reset(new Geometry::Polygon(GetPolygon(vertexes, concave)));
+    result->EnableRasterCache(1 << 20);
+  }
+  return *result;
+}
+
+// Points spread over the polygons' bounding box and a little beyond.
+const std::vector<Geometry::Point>& GetPoints() {
+  static const std::vector<Geometry::Point> points = [] {
+    std::mt19937 random(1);
+    std::uniform_int_distribution<int> coordinate(-kRadius - kRadius / 4,
+                                                  kRadius + kRadius / 4);
+    std::vector<Geometry::Point> result;
+    for (int i = 0; i < kQueries; ++i) {
+      result.emplace_back(coordinate(random), coordinate(random));
+    }
+    return result;
+  }();
+  return points;
+}
+
+// Segments of about a hundredth of the radius.
+const std::vector<Geometry::Segment>& GetSegments() {
+  static const std::vector<Geometry::Segment> segments = [] {
+    std::mt19937 random(2);
+    std::uniform_int_distribution<int> step(-kRadius / 100, kRadius / 100);
+    std::vector<Geometry::Segment> result;
+    for (const Geometry::Point& point : GetPoints()) {
+      result.emplace_back(point,
+                          Geometry::Point(point.point.x + step(random),
+                                          point.point.y + step(random)));
+    }
+    return result;
+  }();
+  return segments;
+}
+
+// Degenerate queries: the vertexes themselves and points on the edges.
+std::vector<Geometry::Point> GetBoundaryPoints(int vertexes, bool concave) {
+  const auto& points = GetVertexes(vertexes, concave);
+  std::vector<Geometry::Point> result;
+  for (int i = 0; i < kQueries; ++i) {
+    const auto& a = points[i % points.size()].point;
+    const auto& b = points[(i + 1) % points.size()].point;
+    if (i % 2 == 0) {
+      result.emplace_back(a);
+    } else {
+      result.emplace_back(a.x + (b.x - a.x) / 2, a.y + (b.y - a.y) / 2);
+    }
+  }
+  return result;
+}
+
+Reference::Vec ToReference(const Geometry::Point& point) {
+  return {point.point.x, point.point.y};
+}
+
+std::vector<Reference::Vec> ToReference(
+    const std::vector<Geometry::Point>& points) {
+  std::vector<Reference::Vec> result;
+  for (const Geometry::Point& point : points) {
+    result.push_back(ToReference(point));
+  }
+  return result;
+}
+
+void SetQueries(benchmark::State& state) {
+  state.SetItemsProcessed(state.iterations());
+}
+
+}  // namespace
+
+// ----------------------------> Simple shapes <----------------------------
+
+static void BM_ContainsPoint(benchmark::State& state,
+                             std::shared_ptr<Geometry::IShape> shape) {
+  const auto& points = GetPoints();
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(shape->ContainsPoint(points[i++ % kQueries]));
+  }
+  SetQueries(state);
+}
+
+static void BM_CrossesSegment(benchmark::State& state,
+                              std::shared_ptr<Geometry::IShape> shape) {
+  const auto& segments = GetSegments();
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(shape->CrossesSegment(segments[i++ % kQueries]));
+  }
+  SetQueries(state);
+}
+
+// The batch kernel; BM_ContainsPoint is its scalar baseline.
+static void BM_ContainsPoints(benchmark::State& state,
+                              std::shared_ptr<Geometry::IShape> shape) {
+  std::vector<int> xs;
+  std::vector<int> ys;
+  for (const auto& point : GetPoints()) {
+    xs.push_back(point.point.x);
+    ys.push_back(point.point.y);
+  }
+  std::vector<uint8_t> out(kQueries);
+  for (auto _ : state) {
+    shape->ContainsPoints(xs.data(), ys.data(), kQueries, out.data());
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetItemsProcessed(state.iterations() * kQueries);
+}
+
+static void BM_SquaredDistance(benchmark::State& state,
+                               std::shared_ptr<Geometry::IShape> shape) {
+  const auto& points = GetPoints();
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(shape->SquaredDistance(points[i++ % kQueries]));
+  }
+  SetQueries(state);
+}
+
+#define GEOMETRY_SHAPE_BENCHMARKS(name, shape)                               \
+  BENCHMARK_CAPTURE(BM_ContainsPoint, name,                                  \
+                    std::shared_ptr<Geometry::IShape>(shape));               \
+  BENCHMARK_CAPTURE(BM_ContainsPoints, name,                                 \
+                    std::shared_ptr<Geometry::IShape>(shape));               \
+  BENCHMARK_CAPTURE(BM_CrossesSegment, name,                                 \
+                    std::shared_ptr<Geometry::IShape>(shape));               \
+  BENCHMARK_CAPTURE(BM_SquaredDistance, name,                                \
+                    std::shared_ptr<Geometry::IShape>(shape))
+
+GEOMETRY_SHAPE_BENCHMARKS(Point, new Geometry::Point(3, 4));
+GEOMETRY_SHAPE_BENCHMARKS(Segment,
+                          new Geometry::Segment(Geometry::Point(-kRadius, 0),
+                                                Geometry::Point(kRadius, 7)));
+GEOMETRY_SHAPE_BENCHMARKS(Ray, new Geometry::Ray(Geometry::Point(0, 0),
+                                                 Geometry::Vector(3, 1)));
+GEOMETRY_SHAPE_BENCHMARKS(Line, new Geometry::Line(Geometry::Point(0, 0),
+                                                   Geometry::Point(3, 1)));
+GEOMETRY_SHAPE_BENCHMARKS(Circle,
+                          new Geometry::Circle(Geometry::Point(5, -5),
+                                               kRadius));
+
+static void BM_ReferenceSegmentCrossesSegment(benchmark::State& state) {
+  const auto& segments = GetSegments();
+  size_t i = 0;
+  for (auto _ : state) {
+    auto borders = segments[i++ % kQueries].GetBorders();
+    benchmark::DoNotOptimize(Reference::SegmentsMeet(
+        {-kRadius, 0}, {kRadius, 7}, ToReference(borders.first),
+        ToReference(borders.second)));
+  }
+  SetQueries(state);
+}
+BENCHMARK(BM_ReferenceSegmentCrossesSegment);
+
+static void BM_ReferenceRayCrossesSegment(benchmark::State& state) {
+  const auto& segments = GetSegments();
+  size_t i = 0;
+  for (auto _ : state) {
+    auto borders = segments[i++ % kQueries].GetBorders();
+    benchmark::DoNotOptimize(Reference::RayMeetsSegment(
+        {0, 0}, {3, 1}, ToReference(borders.first),
+        ToReference(borders.second)));
+  }
+  SetQueries(state);
+}
+BENCHMARK(BM_ReferenceRayCrossesSegment);
+
+static void BM_ReferenceLineCrossesSegment(benchmark::State& state) {
+  const auto& segments = GetSegments();
+  size_t i = 0;
+  for (auto _ : state) {
+    auto borders = segments[i++ % kQueries].GetBorders();
+    benchmark::DoNotOptimize(Reference::LineMeetsSegment(
+        {0, 0}, {3, 1}, ToReference(borders.first),
+        ToReference(borders.second)));
+  }
+  SetQueries(state);
+}
+BENCHMARK(BM_ReferenceLineCrossesSegment);
+
+static void BM_ReferenceCircleCrossesSegment(benchmark::State& state) {
+  const auto& segments = GetSegments();
+  size_t i = 0;
+  for (auto _ : state) {
+    auto borders = segments[i++ % kQueries].GetBorders();
+    benchmark::DoNotOptimize(Reference::CircleMeetsSegment(
+        {5, -5}, kRadius, ToReference(borders.first),
+        ToReference(borders.second)));
+  }
+  SetQueries(state);
+}
+BENCHMARK(BM_ReferenceCircleCrossesSegment);
+
+// -------------------------------> Polygon <-------------------------------
+
+// Arguments: vertex count, concave.
+static void PolygonSizes(benchmark::internal::Benchmark* benchmark) {
+  for (int concave : {0, 1}) {
+    for (int vertexes = 10; vertexes <= 1000000; vertexes *= 10) {
+      benchmark->Args({vertexes, concave});
+    }
+  }
+}
+
+static void BM_PolygonContainsPoint(benchmark::State& state) {
+  const auto& polygon = GetPolygon(state.range(0), state.range(1));
+  const auto& points = GetPoints();
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(polygon.ContainsPoint(points[i++ % kQueries]));
+  }
+  SetQueries(state);
+}
+BENCHMARK(BM_PolygonContainsPoint)->Apply(PolygonSizes);
+
+static void BM_PolygonContainsBoundaryPoint(benchmark::State& state) {
+  const auto& polygon = GetPolygon(state.range(0), state.range(1));
+  const auto points = GetBoundaryPoints(state.range(0), state.range(1));
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(polygon.ContainsPoint(points[i++ % kQueries]));
+  }
+  SetQueries(state);
+}
+BENCHMARK(BM_PolygonContainsBoundaryPoint)->Apply(PolygonSizes);
+
+static void BM_PolygonContainsPoints(benchmark::State& state) {
+  const auto& polygon = GetPolygon(state.range(0), state.range(1));
+  std::vector<int> xs;
+  std::vector<int> ys;
+  for (const auto& point : GetPoints()) {
+    xs.push_back(point.point.x);
+    ys.push_back(point.point.y);
+  }
+  std::vector<uint8_t> out(kQueries);
+  for (auto _ : state) {
+    polygon.ContainsPoints(xs.data(), ys.data(), kQueries, out.data());
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetItemsProcessed(state.iterations() * kQueries);
+}
+BENCHMARK(BM_PolygonContainsPoints)->Apply(PolygonSizes);
+
+// Scalar baseline of the batch kernel over the same points.
+static void BM_PolygonContainsPointsScalar(benchmark::State& state) {
+  const auto& polygon = GetPolygon(state.range(0), state.range(1));
+  const auto& points = GetPoints();
+  std::vector<uint8_t> out(kQueries);
+  for (auto _ : state) {
+    for (int i = 0; i < kQueries; ++i) {
+      out[i] = polygon.ContainsPoint(points[i]);
+    }
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetItemsProcessed(state.iterations() * kQueries);
+}
+BENCHMARK(BM_PolygonContainsPointsScalar)->Apply(PolygonSizes);
+
+static void BM_PolygonContainsPointCached(benchmark::State& state) {
+  const auto& polygon = GetCachedPolygon(state.range(0), state.range(1));
+  const auto& points = GetPoints();
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(polygon.ContainsPoint(points[i++ % kQueries]));
+  }
+  SetQueries(state);
+  state.counters["hit_rate"] = polygon.GetRasterCacheStats().HitRate();
+}
+BENCHMARK(BM_PolygonContainsPointCached)->Apply(PolygonSizes);
+
+static void BM_PolygonCrossesSegment(benchmark::State& state) {
+  const auto& polygon = GetPolygon(state.range(0), state.range(1));
+  const auto& segments = GetSegments();
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        polygon.CrossesSegment(segments[i++ % kQueries]));
+  }
+  SetQueries(state);
+}
+BENCHMARK(BM_PolygonCrossesSegment)->Apply(PolygonSizes);
+
+static void BM_PolygonSquaredDistance(benchmark::State& state) {
+  const auto& polygon = GetPolygon(state.range(0), state.range(1));
+  const auto& points = GetPoints();
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        polygon.SquaredDistance(points[i++ % kQueries]));
+  }
+  SetQueries(state);
+}
+BENCHMARK(BM_PolygonSquaredDistance)->Apply(PolygonSizes);
+
+static void BM_PolygonMove(benchmark::State& state) {
+  Geometry::Polygon polygon(GetPolygon(state.range(0), state.range(1)));
+  int sign = 1;
+  for (auto _ : state) {
+    polygon.Move(Geometry::Vector(sign, -sign));
+    sign = -sign;
+  }
+  SetQueries(state);
+}
+BENCHMARK(BM_PolygonMove)->Apply(PolygonSizes);
+
+static void BM_ReferencePolygonContainsPoint(benchmark::State& state) {
+  const auto vertexes =
+      ToReference(GetVertexes(state.range(0), state.range(1)));
+  const auto& points = GetPoints();
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(Reference::PolygonContains(
+        vertexes, ToReference(points[i++ % kQueries])));
+  }
+  SetQueries(state);
+}
+BENCHMARK(BM_ReferencePolygonContainsPoint)->Apply(PolygonSizes);
+
+static void BM_ReferencePolygonCrossesSegment(benchmark::State& state) {
+  const auto vertexes =
+      ToReference(GetVertexes(state.range(0), state.range(1)));
+  const auto& segments = GetSegments();
+  size_t i = 0;
+  for (auto _ : state) {
+    auto borders = segments[i++ % kQueries].GetBorders();
+    benchmark::DoNotOptimize(Reference::PolygonMeetsSegment(
+        vertexes, ToReference(borders.first), ToReference(borders.second)));
+  }
+  SetQueries(state);
+}
+BENCHMARK(BM_ReferencePolygonCrossesSegment)->Apply(PolygonSizes);
+
+static void BM_PolygonBuild(benchmark::State& state) {
+  const auto& vertexes = GetVertexes(state.range(0), state.range(1));
+  for (auto _ : state) {
+    Geometry::Polygon polygon(vertexes);
+    benchmark::DoNotOptimize(&polygon);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_PolygonBuild)->Apply(PolygonSizes);
+
+static void BM_PolygonEnableRasterCache(benchmark::State& state) {
+  Geometry::Polygon polygon(GetPolygon(state.range(0), state.range(1)));
+  for (auto _ : state) {
+    polygon.EnableRasterCache(1 << 20);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_PolygonEnableRasterCache)
+    ->Apply(PolygonSizes)
+    ->Unit(benchmark::kMillisecond);
+
+static void BM_PolygonToString(benchmark::State& state) {
+  Geometry::Polygon polygon(GetPolygon(state.range(0), state.range(1)));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(polygon.ToString());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_PolygonToString)->Apply(PolygonSizes);
+
+static void BM_PolygonParse(benchmark::State& state) {
+  const std::string text =
+      Geometry::Polygon(GetPolygon(state.range(0), state.range(1))).ToString();
+  for (auto _ : state) {
+    Geometry::Polygon polygon;
+    benchmark::DoNotOptimize(
+        Geometry::Parse(text.data(), text.data() + text.size(), &polygon));
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_PolygonParse)->Apply(PolygonSizes);
+
+// -----------------------------> Segment sets <-----------------------------
+
+// Arguments: segment count, layout. Layout 0 has random segments with about
+// one crossing each, 1 has every segment on one of a few lines, and 2 has
+// runs along one line, each segment overlapping about 32 others.
+static const std::vector<Geometry::Segment>& GetSegmentSet(int count,
+                                                           int layout) {
+  static std::map<std::pair<int, int>, std::vector<Geometry::Segment>> cache;
+  auto& result = cache[{count, layout}];
+  if (!result.empty()) {
+    return result;
+  }
+
+  std::mt19937 random(3);
+  int length = static_cast<int>(kRadius / std::sqrt(count));
+  std::uniform_int_distribution<int> coordinate(-kRadius, kRadius);
+  std::uniform_int_distribution<int> step(-length, length);
+  for (int i = 0; i < count; ++i) {
+    if (layout == 2) {
+      int begin = -kRadius + i * (kRadius / count);
+      result.emplace_back(Geometry::Point(begin, 0),
+                          Geometry::Point(begin + 16 * (kRadius / count), 0));
+      continue;
+    }
+    Geometry::Point begin(coordinate(random),
+                          layout == 1 ? i % 4 * length : coordinate(random));
+    Geometry::Point end(begin.point.x + step(random),
+                        layout == 1 ? begin.point.y
+                                    : begin.point.y + step(random));
+    result.emplace_back(begin, end);
+  }
+  return result;
+}
+
+static void BM_FindIntersections(benchmark::State& state) {
+  const auto& segments = GetSegmentSet(state.range(0), state.range(1));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(Geometry::FindIntersections(segments));
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_FindIntersections)
+    ->ArgsProduct({{1000, 10000, 100000}, {0, 1, 2}})
+    ->Unit(benchmark::kMillisecond);
+
+// Pairwise baseline of the sweep.
+static void BM_ReferencePairwiseIntersections(benchmark::State& state) {
+  const auto& segments = GetSegmentSet(state.range(0), state.range(1));
+  for (auto _ : state) {
+    std::vector<std::pair<size_t, size_t>> result;
+    for (size_t i = 0; i < segments.size(); ++i) {
+      for (size_t j = i + 1; j < segments.size(); ++j) {
+        if (segments[i].CrossesSegment(segments[j])) {
+          result.emplace_back(i, j);
+        }
+      }
+    }
+    benchmark::DoNotOptimize(result.data());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ReferencePairwiseIntersections)
+    ->ArgsProduct({{1000, 10000}, {0, 1, 2}})
+    ->Unit(benchmark::kMillisecond);
+
+// ------------------------------> KD-tree <------------------------------
+
+// Points, or segments about as long as the gaps between them, spread over
+// the same square as the queries.
+static const std::vector<Geometry::Segment>& GetItems(int count,
+                                                      bool segments) {
+  static std::map<std::pair<int, bool>, std::vector<Geometry::Segment>> cache;
+  auto& result = cache[{count, segments}];
+  if (result.empty()) {
+    std::mt19937 random(4);
+    int length = segments ? static_cast<int>(kRadius / std::sqrt(count)) : 0;
+    std::uniform_int_distribution<int> coordinate(-kRadius, kRadius);
+    std::uniform_int_distribution<int> step(-length, length);
+    for (int i = 0; i < count; ++i) {
+      Geometry::Point begin(coordinate(random), coordinate(random));
+      Geometry::Point end(begin.point.x + step(random),
+                          begin.point.y + step(random));
+      result.emplace_back(begin, end);
+    }
+  }
+  return result;
+}
+
+static const Geometry::KdTree& GetKdTree(int count, bool segments) {
+  static std::map<std::pair<int, bool>, std::unique_ptr<Geometry::KdTree>>
+      cache;
+  auto& result = cache[{count, segments}];
+  if (!result) {
+    result.reset(new Geometry::KdTree(GetItems(count, segments)));
+  }
+  return *result;
+}
+
+static void KdTreeSizes(benchmark::internal::Benchmark* benchmark) {
+  benchmark->ArgsProduct({{1000, 10000, 100000, 1000000}, {0, 1}});
+}
+
+static void BM_KdTreeBuild(benchmark::State& state) {
+  const auto& items = GetItems(state.range(0), state.range(1));
+  for (auto _ : state) {
+    Geometry::KdTree tree(items);
+    benchmark::DoNotOptimize(&tree);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_KdTreeBuild)->Apply(KdTreeSizes)->Unit(benchmark::kMillisecond);
+
+static void BM_KdTreeNearest(benchmark::State& state) {
+  const auto& tree = GetKdTree(state.range(0), state.range(1));
+  const auto& points = GetPoints();
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(tree.Nearest(points[i++ % kQueries]));
+  }
+  SetQueries(state);
+}
+BENCHMARK(BM_KdTreeNearest)->Apply(KdTreeSizes);
+
+static void BM_KdTreeNearestK(benchmark::State& state) {
+  const auto& tree = GetKdTree(state.range(0), state.range(1));
+  const auto& points = GetPoints();
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(tree.NearestK(points[i++ % kQueries], 16));
+  }
+  SetQueries(state);
+}
+BENCHMARK(BM_KdTreeNearestK)->Apply(KdTreeSizes);
+
+// The radius takes in about 16 items.
+static void BM_KdTreeWithinRadius(benchmark::State& state) {
+  const auto& tree = GetKdTree(state.range(0), state.range(1));
+  const auto& points = GetPoints();
+  int radius =
+      static_cast<int>(8.0 * kRadius / std::sqrt(M_PI * state.range(0)));
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(tree.WithinRadius(points[i++ % kQueries], radius));
+  }
+  SetQueries(state);
+}
+BENCHMARK(BM_KdTreeWithinRadius)->Apply(KdTreeSizes);
+
+// The linear scan the tree replaces.
+static void BM_LinearNearest(benchmark::State& state) {
+  const auto& items = GetItems(state.range(0), state.range(1));
+  const auto& points = GetPoints();
+  size_t i = 0;
+  for (auto _ : state) {
+    const Geometry::Point& point = points[i++ % kQueries];
+    size_t best = 0;
+    Geometry::Distance2 best_distance = items[0].SquaredDistance(point);
+    for (size_t j = 1; j < items.size(); ++j) {
+      Geometry::Distance2 distance = items[j].SquaredDistance(point);
+      if (distance < best_distance) {
+        best = j;
+        best_distance = distance;
+      }
+    }
+    benchmark::DoNotOptimize(best);
+  }
+  SetQueries(state);
+}
+BENCHMARK(BM_LinearNearest)->Apply(KdTreeSizes);
+
+// ----------------------------> Query engine <----------------------------
+
+static int MaxThreads() {
+  return std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+}
+
+static std::vector<const Geometry::IShape*> GetEngineShapes() {
+  std::vector<const Geometry::IShape*> shapes;
+  for (bool concave : {false, true}) {
+    for (int vertexes = 10; vertexes <= 100000; vertexes *= 10) {
+      shapes.push_back(&GetPolygon(vertexes, concave));
+    }
+  }
+  return shapes;
+}
+
+static void BM_QueryEngineContainsPoints(benchmark::State& state) {
+  const auto shapes = GetEngineShapes();
+  Geometry::QueryEngine engine(state.range(0));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(engine.ContainsPoints(GetPoints(), shapes));
+  }
+  state.SetItemsProcessed(state.iterations() * kQueries * shapes.size());
+}
+BENCHMARK(BM_QueryEngineContainsPoints)
+    ->RangeMultiplier(2)
+    ->Range(1, MaxThreads())
+    ->UseRealTime();
+
+static void BM_QueryEngineCrossesSegments(benchmark::State& state) {
+  const auto shapes = GetEngineShapes();
+  Geometry::QueryEngine engine(state.range(0));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(engine.CrossesSegments(GetSegments(), shapes));
+  }
+  state.SetItemsProcessed(state.iterations() * kQueries * shapes.size());
+}
+BENCHMARK(BM_QueryEngineCrossesSegments)
+    ->RangeMultiplier(2)
+    ->Range(1, MaxThreads())
+    ->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -1,546 +1,3599 @@
 #include <assert.h>
+#include <algorithm>
+#include <atomic>
+#include <charconv>
 #include <cmath>
+#include <compare>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <initializer_list>
 #include <iostream>
+#include <limits>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <random>
-#include <sstream>
+#include <set>
 #include <string>
+#include <thread>
+#include <type_traits>
 #include <vector>
 
 namespace Geometry {
 
-class Vector;
+template <class T>
+class BasicVector;
+
+template <class T>
+class BasicIShape;
+template <class T>
+class BasicPoint;
+template <class T>
+class BasicSegment;
+template <class T>
+class BasicRay;
+template <class T>
+class BasicLine;
+template <class T>
+class BasicCircle;
+template <class T>
+class BasicPolygon;
+
+template <class T>
+struct BasicBox;
+template <class T>
+class BasicRasterCache;
+template <class T>
+struct BasicDistance2;
 
-class IShape;
-class Point;
-class Segment;
-class Ray;
-class Line;
-class Circle;
-class Polygon;
+//////////////////////////////////////////////////////////////////////////////////
+
+// Signed 256-bit integer in two's complement. Differences of long long
+// coordinates take 65 bits and their products up to 130, past __int128.
+struct Int256 {
+  Int256() = default;
+  Int256(__int128 value);  // Implicit, as built-in integers widen.
+  Int256(unsigned __int128 high, unsigned __int128 low);
+
+  explicit operator long double() const;
+  explicit operator double() const;
+
+  unsigned __int128 high = 0;
+  unsigned __int128 low = 0;
+};
+
+inline Int256 operator-(const Int256& value);
+inline Int256 operator+(const Int256& first, const Int256& second);
+inline Int256 operator-(const Int256& first, const Int256& second);
+// Product modulo 2^256, so exact whenever it fits.
+inline Int256 operator*(const Int256& first, const Int256& second);
+inline Int256& operator+=(Int256& first, const Int256& second);
+inline Int256& operator-=(Int256& first, const Int256& second);
+inline std::strong_ordering operator<=>(const Int256& first,
+                                        const Int256& second);
+inline bool operator==(const Int256& first, const Int256& second);
+
+// Arithmetic used by the predicates for a coordinate type. Differences of
+// coordinates are taken in Wide and products of differences in Exact, so for
+// integral coordinates every sign test and distance is exact over the whole
+// range of the type.
+template <class T>
+struct CoordTraits;
+
+template <>
+struct CoordTraits<int> {
+  using Wide = long long;
+  using Exact = __int128;
+};
+
+template <>
+struct CoordTraits<long long> {
+  using Wide = __int128;
+  using Exact = Int256;
+};
+
+template <>
+struct CoordTraits<double> {
+  using Wide = double;
+  using Exact = double;
+};
 
 //////////////////////////////////////////////////////////////////////////////////
 
-class Vector {
+template <class T>
+class BasicVector {
  public:
-  Vector() = default;
-  Vector(int x, int y);
+  using Wide = typename CoordTraits<T>::Wide;
+
+  BasicVector() = default;
+  BasicVector(T x, T y);
   std::string ToString();
+  char* AppendTo(char* first, char* last) const;
 
-  Vector& operator+=(const Vector& other);
-  Vector& operator-=(const Vector& other);
-  Vector& operator*=(int num);
-  Vector& operator-();
-
-  friend long long operator*(const Vector& first, const Vector& second);
-  friend long long operator^(const Vector& first, const Vector& second);
-  friend Vector operator*(const Vector& vec, int num);
-  friend Vector operator*(int num, const Vector& vec);
-  friend Vector operator-(const Vector& first, const Vector& second);
-  friend Vector operator+(const Vector& first, const Vector& second);
-  friend bool operator==(const Vector& first, const Vector& second);
-
-  int x;
-  int y;
+  BasicVector& operator+=(const BasicVector& other);
+  BasicVector& operator-=(const BasicVector& other);
+  BasicVector& operator*=(T num);
+  BasicVector& operator-();
+
+  T x;
+  T y;
 };
 
+template <class T>
+typename CoordTraits<T>::Wide operator*(const BasicVector<T>& first,
+                                        const BasicVector<T>& second);
+template <class T>
+typename CoordTraits<T>::Wide operator^(const BasicVector<T>& first,
+                                        const BasicVector<T>& second);
+template <class T>
+BasicVector<T> operator*(const BasicVector<T>& vec,
+                         std::type_identity_t<T> num);
+template <class T>
+BasicVector<T> operator*(std::type_identity_t<T> num,
+                         const BasicVector<T>& vec);
+template <class T>
+BasicVector<T> operator-(const BasicVector<T>& first,
+                         const BasicVector<T>& second);
+template <class T>
+BasicVector<T> operator+(const BasicVector<T>& first,
+                         const BasicVector<T>& second);
+template <class T>
+bool operator==(const BasicVector<T>& first, const BasicVector<T>& second);
+
 //////////////////////////////////////////////////////////////////////////////////
 
-class IShape {
- public:
-  virtual ~IShape() = default;
+// Squared distance whole + remainder / denominator with 0 <= remainder <
+// denominator, so that distances to segments and lines are kept exactly.
+// Floating point distances only use whole.
+template <class T>
+struct BasicDistance2 {
+  using Exact = typename CoordTraits<T>::Exact;
+
+  BasicDistance2() = default;
+  explicit BasicDistance2(Exact whole);
+  // numerator^2 / denominator; denominator must be positive.
+  static BasicDistance2 SquareOver(Exact numerator, Exact denominator);
 
-  virtual IShape& Move(const Vector& shift) = 0;
-  virtual bool ContainsPoint(const Point& other) const = 0;
-  virtual bool CrossesSegment(const Segment& other) const = 0;
-  virtual IShape* Clone() const = 0;
+  double ToDouble() const;
+
+  Exact whole = 0;
+  Exact remainder = 0;
+  Exact denominator = 1;
+};
+
+template <class T>
+std::strong_ordering operator<=>(const BasicDistance2<T>& first,
+                                 const BasicDistance2<T>& second);
+template <class T>
+bool operator==(const BasicDistance2<T>& first,
+                const BasicDistance2<T>& second);
+
+//////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+class BasicIShape {
+ public:
+  virtual ~BasicIShape() = default;
+
+  virtual BasicIShape& Move(const BasicVector<T>& shift) = 0;
+  virtual bool ContainsPoint(const BasicPoint<T>& other) const = 0;
+  virtual bool CrossesSegment(const BasicSegment<T>& other) const = 0;
+  // Squared distance from the point to the shape; zero iff ContainsPoint.
+  virtual BasicDistance2<T> SquaredDistance(
+      const BasicPoint<T>& other) const = 0;
+  virtual BasicIShape* Clone() const = 0;
   virtual std::string ToString() = 0;
+  // Writes the ToString() text to [first, last) and returns its end, or
+  // nullptr if it does not fit.
+  virtual char* AppendTo(char* first, char* last) const = 0;
+
+  // Batch form of ContainsPoint over structure-of-arrays coordinates:
+  // out[i] = ContainsPoint(Point(xs[i], ys[i])).
+  virtual void ContainsPoints(const T* xs, const T* ys, size_t n,
+                              uint8_t* out) const;
 };
 
 //////////////////////////////////////////////////////////////////////////////////
 
-class Point : public IShape {
+template <class T>
+class BasicPoint : public BasicIShape<T> {
  public:
-  Point() = default;
-  Point(const Vector& point);
-  Point(int x, int y);
-
-  IShape& Move(const Vector& shift) override;
-  bool ContainsPoint(const Point& other) const override;
-  bool CrossesSegment(const Segment& other) const override;
-  IShape* Clone() const override;
+  BasicPoint() = default;
+  BasicPoint(const BasicVector<T>& point);
+  BasicPoint(T x, T y);
+
+  BasicIShape<T>& Move(const BasicVector<T>& shift) override;
+  bool ContainsPoint(const BasicPoint& other) const override;
+  bool CrossesSegment(const BasicSegment<T>& other) const override;
+  BasicDistance2<T> SquaredDistance(const BasicPoint<T>& other) const override;
+  BasicIShape<T>* Clone() const override;
   std::string ToString() override;
+  char* AppendTo(char* first, char* last) const override;
+  void ContainsPoints(const T* xs, const T* ys, size_t n,
+                      uint8_t* out) const override;
 
-  friend Vector operator-(const Point& first, const Point& second);
-
-  Vector point;
+  BasicVector<T> point;
 };
 
+template <class T>
+BasicVector<T> operator-(const BasicPoint<T>& first,
+                         const BasicPoint<T>& second);
+
 //////////////////////////////////////////////////////////////////////////////////
 
-class Segment : public IShape {
+template <class T>
+class BasicSegment : public BasicIShape<T> {
  public:
-  Segment() = default;
-  Segment(const Point& begin, const Point& end);
-
-  IShape& Move(const Vector& shift) override;
-  bool ContainsPoint(const Point& other) const override;
-  bool CrossesSegment(const Segment& other) const override;
-  IShape* Clone() const override;
+  BasicSegment() = default;
+  BasicSegment(const BasicPoint<T>& begin, const BasicPoint<T>& end);
+
+  BasicIShape<T>& Move(const BasicVector<T>& shift) override;
+  bool ContainsPoint(const BasicPoint<T>& other) const override;
+  bool CrossesSegment(const BasicSegment& other) const override;
+  BasicDistance2<T> SquaredDistance(const BasicPoint<T>& other) const override;
+  BasicIShape<T>* Clone() const override;
   std::string ToString() override;
-  std::pair<Point, Point> GetBorders() const;
+  char* AppendTo(char* first, char* last) const override;
+  void ContainsPoints(const T* xs, const T* ys, size_t n,
+                      uint8_t* out) const override;
+  std::pair<BasicPoint<T>, BasicPoint<T>> GetBorders() const;
 
  private:
-  Point begin_;
-  Point end_;
+  BasicPoint<T> begin_;
+  BasicPoint<T> end_;
 };
 
 //////////////////////////////////////////////////////////////////////////////////
 
-class Ray : public IShape {
+template <class T>
+class BasicRay : public BasicIShape<T> {
  public:
-  Ray() = default;
-  Ray(const Point& begin, const Point& end);
-  Ray(const Point& begin, const Vector& dir);
-
-  IShape& Move(const Vector& shift) override;
-  bool ContainsPoint(const Point& other) const override;
-  bool CrossesSegment(const Segment& other) const override;
-  IShape* Clone() const override;
+  BasicRay() = default;
+  BasicRay(const BasicPoint<T>& begin, const BasicPoint<T>& end);
+  BasicRay(const BasicPoint<T>& begin, const BasicVector<T>& dir);
+
+  BasicIShape<T>& Move(const BasicVector<T>& shift) override;
+  bool ContainsPoint(const BasicPoint<T>& other) const override;
+  bool CrossesSegment(const BasicSegment<T>& other) const override;
+  BasicDistance2<T> SquaredDistance(const BasicPoint<T>& other) const override;
+  BasicIShape<T>* Clone() const override;
   std::string ToString() override;
+  char* AppendTo(char* first, char* last) const override;
+  void ContainsPoints(const T* xs, const T* ys, size_t n,
+                      uint8_t* out) const override;
 
  private:
-  Point begin_;
-  Vector direction_;
+  BasicPoint<T> begin_;
+  BasicVector<T> direction_;
 };
 
 //////////////////////////////////////////////////////////////////////////////////
 
-class Line : public IShape {
+template <class T>
+class BasicLine : public BasicIShape<T> {
  public:
-  Line() = default;
-  Line(const Point& begin, const Point& end);
+  BasicLine() = default;
+  BasicLine(const BasicPoint<T>& begin, const BasicPoint<T>& end);
+
+  BasicIShape<T>& Move(const BasicVector<T>& shift) override;
+  bool ContainsPoint(const BasicPoint<T>& other) const override;
+  bool CrossesSegment(const BasicSegment<T>& other) const override;
+  BasicDistance2<T> SquaredDistance(const BasicPoint<T>& other) const override;
+  BasicIShape<T>* Clone() const override;
+  std::string ToString() override;
+  char* AppendTo(char* first, char* last) const override;
+  void ContainsPoints(const T* xs, const T* ys, size_t n,
+                      uint8_t* out) const override;
+
+ private:
+  typename CoordTraits<T>::Wide a_;
+  typename CoordTraits<T>::Wide b_;
+  typename CoordTraits<T>::Exact c_;
+
+  BasicPoint<T> first_;
+  BasicPoint<T> second_;
+};
+
+//////////////////////////////////////////////////////////////////////////////////
 
-  IShape& Move(const Vector& shift) override;
-  bool ContainsPoint(const Point& other) const override;
-  bool CrossesSegment(const Segment& other) const override;
-  IShape* Clone() const override;
+template <class T>
+class BasicCircle : public BasicIShape<T> {
+ public:
+  BasicCircle() = default;
+  BasicCircle(const BasicPoint<T>& k_center, T radius);
+
+  BasicIShape<T>& Move(const BasicVector<T>& shift) override;
+  bool ContainsPoint(const BasicPoint<T>& other) const override;
+  bool CrossesSegment(const BasicSegment<T>& other) const override;
+  BasicDistance2<T> SquaredDistance(const BasicPoint<T>& other) const override;
+  BasicIShape<T>* Clone() const override;
   std::string ToString() override;
+  char* AppendTo(char* first, char* last) const override;
+  void ContainsPoints(const T* xs, const T* ys, size_t n,
+                      uint8_t* out) const override;
 
  private:
-  int a_;
-  int b_;
-  int c_;
+  BasicPoint<T> center_;
+  T radius_;
+};
+
+//////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+struct BasicBox {
+  static BasicBox Empty();
+  static BasicBox Of(const BasicVector<T>& first, const BasicVector<T>& second);
 
-  Point first_;
-  Point second_;
+  bool Intersects(const BasicBox& other) const;
+  void Expand(const BasicBox& other);
+
+  T min_x;
+  T min_y;
+  T max_x;
+  T max_y;
 };
 
 //////////////////////////////////////////////////////////////////////////////////
 
-class Circle : public IShape {
+struct RasterCacheStats {
+  double HitRate() const;
+
+  size_t lookups = 0;
+  size_t hits = 0;
+  size_t memory_bytes = 0;
+};
+
+// Two-level bitmap over a polygon's bounding box. Coarse cells are outside,
+// inside or boundary; boundary cells may be refined into kFine x kFine finer
+// cells of the same kinds. Cells are closed rectangles, so a cell no edge
+// touches lies entirely on one side of the boundary.
+template <class T>
+class BasicRasterCache {
  public:
-  Circle() = default;
-  Circle(const Point& k_center, int radius);
+  enum State : uint8_t { kOutside = 0, kInside = 1, kBoundary = 2 };
+
+  static constexpr size_t kFine = 16;
+
+  // Counts towards the statistics; kBoundary is a miss.
+  State Lookup(const BasicVector<T>& point) const;
+  RasterCacheStats GetStats() const;
+
+ private:
+  friend class BasicPolygon<T>;
+
+  // Values of coarse_ from kRefined on are kRefined + block number.
+  static constexpr uint32_t kRefined = 3;
+
+  State Classify(const BasicVector<T>& point) const;
+  size_t ColumnOf(T x) const;
+  size_t RowOf(T y) const;
+  BasicBox<T> CellBox(size_t column, size_t row) const;
+  BasicBox<T> FineBox(const BasicBox<T>& cell, size_t column,
+                      size_t row) const;
+  size_t FineColumns(const BasicBox<T>& cell) const;
+  size_t FineRows(const BasicBox<T>& cell) const;
+  State FineState(size_t index) const;
+  void SetFineState(size_t index, State state);
+
+  BasicBox<T> box_;
+  typename CoordTraits<T>::Wide cell_width_ = 1;
+  typename CoordTraits<T>::Wide cell_height_ = 1;
+  typename CoordTraits<T>::Wide fine_width_ = 1;
+  typename CoordTraits<T>::Wide fine_height_ = 1;
+  size_t columns_ = 0;
+  size_t rows_ = 0;
+
+  std::vector<uint32_t> coarse_;
+  // 2-bit states, kFine * kFine per refined block, row by row.
+  std::vector<uint8_t> fine_;
+
+  mutable std::atomic<size_t> lookups_{0};
+  mutable std::atomic<size_t> hits_{0};
+};
+
+//////////////////////////////////////////////////////////////////////////////////
 
-  IShape& Move(const Vector& shift) override;
-  bool ContainsPoint(const Point& other) const override;
-  bool CrossesSegment(const Segment& other) const override;
-  IShape* Clone() const override;
+template <class T>
+class BasicPolygon : public BasicIShape<T> {
+ public:
+  BasicPolygon() = default;
+  BasicPolygon(std::vector<BasicPoint<T>> vertexes);
+
+  // O(1): the shift is only added to a pending offset.
+  BasicIShape<T>& Move(const BasicVector<T>& shift) override;
+  bool ContainsPoint(const BasicPoint<T>& other) const override;
+  bool CrossesSegment(const BasicSegment<T>& other) const override;
+  BasicDistance2<T> SquaredDistance(const BasicPoint<T>& other) const override;
+  BasicIShape<T>* Clone() const override;
   std::string ToString() override;
+  char* AppendTo(char* first, char* last) const override;
+  void ContainsPoints(const T* xs, const T* ys, size_t n,
+                      uint8_t* out) const override;
+
+  // Folds the pending offset into the vertexes, rebuilding the index and the
+  // raster cache.
+  void Materialize();
+
+  // Builds a raster cache of at most about memory_bytes; ContainsPoint then
+  // answers points in inside and outside cells in O(1). Copies share it.
+  void EnableRasterCache(size_t memory_bytes);
+  void DisableRasterCache();
+  RasterCacheStats GetRasterCacheStats() const;
 
  private:
-  Point center_;
-  int radius_;
+  // Polygons with fewer edges are scanned linearly.
+  static constexpr size_t kIndexThreshold = 64;
+  static constexpr size_t kLeafEdges = 8;
+
+  struct Edge {
+    BasicVector<T> begin;
+    BasicVector<T> end;
+    BasicBox<T> box;
+  };
+
+  void BuildIndex();
+  template <class Visitor>
+  bool VisitEdges(const BasicBox<T>& box, Visitor visit) const;
+  bool ToLocal(const BasicVector<T>& point, BasicVector<T>* local) const;
+  BasicVector<T> ToWorld(const BasicVector<T>& local) const;
+  void ContainsLocalPoints(const T* xs, const T* ys, size_t n,
+                           uint8_t* out) const;
+  bool ContainsPointExact(const BasicVector<T>& origin) const;
+  BasicDistance2<T> EdgesDistance2(const BasicVector<T>& origin) const;
+  void ContainsPointsExact(const T* xs, const T* ys, size_t n,
+                           uint8_t* out) const;
+  void BuildRasterCache(size_t memory_bytes);
+
+  // The polygon is vertexes_ shifted by (offset_x_, offset_y_); the edges,
+  // the index and the raster cache are all in the coordinates of vertexes_.
+  // The offset is kept in Wide, so moves summing past the range of T do not
+  // overflow as long as the polygon itself ends up in range.
+  std::vector<BasicPoint<T>> vertexes_;
+  typename CoordTraits<T>::Wide offset_x_ = 0;
+  typename CoordTraits<T>::Wide offset_y_ = 0;
+  // Edge i goes from vertexes_[i] to vertexes_[(i + 1) % size].
+  std::vector<Edge> edges_;
+  // Segment tree of edge bounding boxes: leaf leaves_ + j covers edges
+  // [j * kLeafEdges, (j + 1) * kLeafEdges), node i covers nodes 2i and 2i + 1.
+  std::vector<BasicBox<T>> tree_;
+  size_t leaves_ = 0;
+
+  std::shared_ptr<const BasicRasterCache<T>> raster_cache_;
+  size_t raster_memory_ = 0;
 };
 
 //////////////////////////////////////////////////////////////////////////////////
 
-class Polygon : public IShape {
+using Vector = BasicVector<int>;
+using Distance2 = BasicDistance2<int>;
+
+using IShape = BasicIShape<int>;
+using Point = BasicPoint<int>;
+using Segment = BasicSegment<int>;
+using Ray = BasicRay<int>;
+using Line = BasicLine<int>;
+using Circle = BasicCircle<int>;
+using Polygon = BasicPolygon<int>;
+
+//////////////////////////////////////////////////////////////////////////////////
+
+// Bentley-Ottmann sweep over the segments: returns every pair (i, j), i < j,
+// for which segments[i].CrossesSegment(segments[j]) holds, in sorted order.
+// Runs in O((n + k) log n) for n segments and k reported pairs.
+inline std::vector<std::pair<size_t, size_t>> FindIntersections(
+    const std::vector<Segment>& segments);
+
+//////////////////////////////////////////////////////////////////////////////////
+
+// Parsers of the ToString text, reading straight from [first, last) with
+// whitespace allowed between tokens. Each returns the end of the parsed text,
+// or nullptr, leaving *out as is, if the text does not match. Lines have no
+// parser: their text does not keep the points they are built from.
+template <class T>
+const char* Parse(const char* first, const char* last, BasicVector<T>* out);
+template <class T>
+const char* Parse(const char* first, const char* last, BasicPoint<T>* out);
+template <class T>
+const char* Parse(const char* first, const char* last, BasicSegment<T>* out);
+template <class T>
+const char* Parse(const char* first, const char* last, BasicRay<T>* out);
+template <class T>
+const char* Parse(const char* first, const char* last, BasicCircle<T>* out);
+template <class T>
+const char* Parse(const char* first, const char* last, BasicPolygon<T>* out);
+// Any of the shapes above, told apart by name.
+template <class T>
+const char* Parse(const char* first, const char* last,
+                  std::unique_ptr<BasicIShape<T>>* out);
+
+//////////////////////////////////////////////////////////////////////////////////
+
+// Fixed set of worker threads, each with its own deque of task indexes. A
+// worker takes tasks from the back of its own deque and, once that is empty,
+// steals from the front of the others', so uneven tasks balance out.
+class WorkStealingPool {
  public:
-  Polygon() = default;
-  Polygon(const std::vector<Point>& vertexes);
+  explicit WorkStealingPool(
+      size_t threads = std::thread::hardware_concurrency());
+  WorkStealingPool(const WorkStealingPool&) = delete;
+  WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+  ~WorkStealingPool();
 
-  IShape& Move(const Vector& shift) override;
-  bool ContainsPoint(const Point& other) const override;
-  bool CrossesSegment(const Segment& other) const override;
-  IShape* Clone() const override;
-  std::string ToString() override;
+  size_t Size() const;
+  // Calls task(i) for every i in [0, count) and waits for all of them. Not
+  // to be called from several threads at once.
+  void Run(size_t count, const std::function<void(size_t)>& task);
+
+ private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<size_t> tasks;
+  };
+
+  void Work(size_t worker);
+  bool Take(size_t worker, size_t* task);
+
+  size_t size_;
+  std::unique_ptr<Queue[]> queues_;
+  std::vector<std::thread> threads_;
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable done_;
+  const std::function<void(size_t)>* task_ = nullptr;
+  std::atomic<size_t> remaining_ = 0;
+  size_t generation_ = 0;
+  bool stop_ = false;
+};
+
+// Evaluates a predicate for every pair of a query and a shape on a
+// WorkStealingPool. Queries are split into chunks with a result buffer each;
+// the buffers are joined in chunk order, so the pairs come out sorted by
+// (query, shape) for any number of threads. Shapes are only used through
+// their const methods and must outlive the call.
+template <class T>
+class BasicQueryEngine {
+ public:
+  explicit BasicQueryEngine(
+      size_t threads = std::thread::hardware_concurrency());
+
+  size_t Threads() const;
+  // Pairs (i, j) with shapes[j]->ContainsPoint(points[i]).
+  std::vector<std::pair<size_t, size_t>> ContainsPoints(
+      const std::vector<BasicPoint<T>>& points,
+      const std::vector<const BasicIShape<T>*>& shapes);
+  // Pairs (i, j) with shapes[j]->CrossesSegment(segments[i]).
+  std::vector<std::pair<size_t, size_t>> CrossesSegments(
+      const std::vector<BasicSegment<T>>& segments,
+      const std::vector<const BasicIShape<T>*>& shapes);
 
  private:
-  std::vector<Point> vertexes_;
+  static constexpr size_t kChunk = 256;
+
+  // fill(first, last, hits) appends the pairs of queries [first, last).
+  template <class Fill>
+  std::vector<std::pair<size_t, size_t>> Collect(size_t count, Fill fill);
+
+  WorkStealingPool pool_;
 };
 
+using QueryEngine = BasicQueryEngine<int>;
+
 //////////////////////////////////////////////////////////////////////////////////
 
-// ---------------------------------> Vector <---------------------------------
+// Static KD-tree over segments, points being segments with equal ends, for
+// queries by exact squared distance. Items are split at the median of their
+// centres along the wider axis, so for evenly spread items a query looks at
+// O(log n) leaves. The nodes are boxes in one array laid out like the polygon
+// edge index, and the items are kept in leaf order.
+template <class T>
+class BasicKdTree {
+ public:
+  BasicKdTree() = default;
+  explicit BasicKdTree(const std::vector<BasicPoint<T>>& points);
+  explicit BasicKdTree(const std::vector<BasicSegment<T>>& segments);
+
+  size_t Size() const;
+  // Index of the item nearest to the point, the least one on ties. The tree
+  // must not be empty.
+  size_t Nearest(const BasicPoint<T>& point) const;
+  // Indexes of the min(k, Size()) nearest items, by distance, then by index.
+  std::vector<size_t> NearestK(const BasicPoint<T>& point, size_t k) const;
+  // Indexes of the items at distance at most radius, in increasing order.
+  std::vector<size_t> WithinRadius(const BasicPoint<T>& point,
+                                   T radius) const;
 
-Vector::Vector(int x, int y) : x(x), y(y) {}
+ private:
+  static constexpr size_t kLeafItems = 8;
+
+  struct Item {
+    BasicVector<T> begin;
+    BasicVector<T> end;
+    size_t index;
+  };
+
+  void Build();
+  void Split(size_t first_leaf, size_t last_leaf);
+  // Calls visit(item) for the items that accept(distance) lets through by
+  // the distance to their boxes, nearer subtrees first.
+  template <class Accept, class Visitor>
+  void Search(const BasicVector<T>& point, Accept accept,
+              Visitor visit) const;
+
+  // Leaf j holds items_[j * kLeafItems, (j + 1) * kLeafItems).
+  std::vector<Item> items_;
+  std::vector<BasicBox<T>> tree_;
+  size_t leaves_ = 0;
+};
 
-Vector& Vector::operator+=(const Vector& other) {
-  x += other.x;
-  y += other.y;
-  return *this;
+using KdTree = BasicKdTree<int>;
+
+//////////////////////////////////////////////////////////////////////////////////
+
+// ----------------------------> Exact arithmetic <----------------------------
+
+template <class N>
+int Sign(N value) {
+  return (value > 0) - (value < 0);
 }
 
-Vector& Vector::operator-=(const Vector& other) {
-  x -= other.x;
-  y -= other.y;
-  return *this;
+inline unsigned __int128 Magnitude(__int128 value) {
+  return value < 0 ? -static_cast<unsigned __int128>(value)
+                   : static_cast<unsigned __int128>(value);
 }
 
-Vector& Vector::operator*=(int num) {
-  x *= num;
-  y *= num;
-  return *this;
+// Full 256-bit product of two unsigned 128-bit numbers.
+inline void MultiplyWide(unsigned __int128 first, unsigned __int128 second,
+                         unsigned __int128* high, unsigned __int128* low) {
+  const unsigned __int128 kMask = ~static_cast<uint64_t>(0);
+  unsigned __int128 low_low = (first & kMask) * (second & kMask);
+  unsigned __int128 low_high = (first & kMask) * (second >> 64);
+  unsigned __int128 high_low = (first >> 64) * (second & kMask);
+  unsigned __int128 high_high = (first >> 64) * (second >> 64);
+
+  unsigned __int128 middle =
+      (low_low >> 64) + (low_high & kMask) + (high_low & kMask);
+  *low = (low_low & kMask) | (middle << 64);
+  *high = high_high + (low_high >> 64) + (high_low >> 64) + (middle >> 64);
 }
 
-Vector& Vector::operator-() { return (*this *= -1); }
+// Sign of a * b - c * d, exact for any 128-bit arguments.
+inline int CompareProducts(__int128 a, __int128 b, __int128 c, __int128 d) {
+  int first_sign = Sign(a) * Sign(b);
+  int second_sign = Sign(c) * Sign(d);
+  if (first_sign != second_sign) {
+    return first_sign > second_sign ? 1 : -1;
+  }
+  if (first_sign == 0) {
+    return 0;
+  }
 
-long long operator*(const Vector& first, const Vector& second) {
-  return first.x * second.x + first.y * second.y;
+  unsigned __int128 first_high = 0;
+  unsigned __int128 first_low = 0;
+  unsigned __int128 second_high = 0;
+  unsigned __int128 second_low = 0;
+  MultiplyWide(Magnitude(a), Magnitude(b), &first_high, &first_low);
+  MultiplyWide(Magnitude(c), Magnitude(d), &second_high, &second_low);
+
+  int magnitude_order = 0;
+  if (first_high != second_high) {
+    magnitude_order = first_high > second_high ? 1 : -1;
+  } else if (first_low != second_low) {
+    magnitude_order = first_low > second_low ? 1 : -1;
+  }
+  return first_sign * magnitude_order;
 }
 
-Vector operator+(const Vector& first, const Vector& second) {
-  Vector temp(first);
-  temp += second;
-  return temp;
+inline int CompareProducts(double a, double b, double c, double d) {
+  return Sign(a * b - c * d);
 }
 
-Vector operator-(const Vector& first, const Vector& second) {
-  Vector temp(first);
-  temp -= second;
-  return temp;
-}
+inline Int256::Int256(__int128 value)
+    : high(value < 0 ? ~static_cast<unsigned __int128>(0) : 0),
+      low(static_cast<unsigned __int128>(value)) {}
 
-long long operator^(const Vector& first, const Vector& second) {
-  return first.x * second.y - second.x * first.y;
+inline Int256::Int256(unsigned __int128 high, unsigned __int128 low)
+    : high(high), low(low) {}
+
+inline Int256::operator long double() const {
+  if (static_cast<__int128>(high) < 0) {
+    return -static_cast<long double>(-*this);
+  }
+  return static_cast<long double>(high) * 0x1p128L +
+         static_cast<long double>(low);
 }
 
-Vector operator*(const Vector& vec, int num) {
-  Vector temp(vec);
-  temp *= num;
-  return temp;
+inline Int256::operator double() const {
+  return static_cast<double>(static_cast<long double>(*this));
 }
 
-Vector operator*(int num, const Vector& vec) { return (vec * num); }
+inline Int256 operator-(const Int256& value) {
+  return Int256() - value;
+}
 
-bool operator==(const Vector& first, const Vector& second) {
-  return (first.x == second.x && first.y == second.y);
+inline Int256 operator+(const Int256& first, const Int256& second) {
+  unsigned __int128 low = first.low + second.low;
+  return Int256(first.high + second.high + (low < first.low), low);
 }
 
-std::string Vector::ToString() {
-  std::ostringstream string_stream;
-  string_stream << "Vector(" << x << ", " << y << ")";
-  return string_stream.str();
+inline Int256 operator-(const Int256& first, const Int256& second) {
+  return Int256(first.high - second.high - (first.low < second.low),
+                first.low - second.low);
 }
 
-// ---------------------------------> Point <---------------------------------
+inline Int256 operator*(const Int256& first, const Int256& second) {
+  unsigned __int128 high = 0;
+  unsigned __int128 low = 0;
+  MultiplyWide(first.low, second.low, &high, &low);
+  return Int256(high + first.low * second.high + first.high * second.low,
+                low);
+}
 
-Point::Point(const Vector& point) : point(point) {}
+inline Int256& operator+=(Int256& first, const Int256& second) {
+  return first = first + second;
+}
 
-Point::Point(int x, int y) : point(x, y) {}
+inline Int256& operator-=(Int256& first, const Int256& second) {
+  return first = first - second;
+}
 
-IShape& Point::Move(const Vector& shift) {
-  point += shift;
-  return *this;
+inline std::strong_ordering operator<=>(const Int256& first,
+                                        const Int256& second) {
+  if (first.high != second.high) {
+    return static_cast<__int128>(first.high) <=>
+           static_cast<__int128>(second.high);
+  }
+  return first.low <=> second.low;
 }
 
-bool Point::ContainsPoint(const Point& other) const {
-  return point == other.point;
+inline bool operator==(const Int256& first, const Int256& second) {
+  return first.high == second.high && first.low == second.low;
 }
 
-bool Point::CrossesSegment(const Segment& other) const {
-  return other.ContainsPoint(*this);
+// The helpers below take and return Int256 magnitudes as unsigned numbers.
+
+inline Int256 Magnitude(const Int256& value) {
+  return value < 0 ? -value : value;
 }
 
-IShape* Point::Clone() const { return new Point(*this); }
+inline int CompareMagnitudes(const Int256& first, const Int256& second) {
+  if (first.high != second.high) {
+    return first.high > second.high ? 1 : -1;
+  }
+  return (first.low > second.low) - (first.low < second.low);
+}
 
-std::string Point::ToString() {
-  std::ostringstream string_stream;
-  string_stream << "Point(" << point.x << ", " << point.y << ")";
-  return string_stream.str();
+// Full 512-bit product of two unsigned 256-bit numbers.
+inline void MultiplyWide(const Int256& first, const Int256& second,
+                         Int256* high, Int256* low) {
+  Int256 low_low;
+  Int256 low_high;
+  Int256 high_low;
+  Int256 high_high;
+  MultiplyWide(first.low, second.low, &low_low.high, &low_low.low);
+  MultiplyWide(first.low, second.high, &low_high.high, &low_high.low);
+  MultiplyWide(first.high, second.low, &high_low.high, &high_low.low);
+  MultiplyWide(first.high, second.high, &high_high.high, &high_high.low);
+
+  Int256 middle = Int256(0, low_low.high) + Int256(0, low_high.low) +
+                  Int256(0, high_low.low);
+  *low = Int256(middle.low, low_low.low);
+  *high = high_high + Int256(0, low_high.high) + Int256(0, high_low.high) +
+          Int256(0, middle.high);
 }
 
-Vector operator-(const Point& first, const Point& second) {
-  return first.point - second.point;
+// Sign of a * b - c * d, exact for any 256-bit arguments.
+inline int CompareProducts(const Int256& a, const Int256& b, const Int256& c,
+                           const Int256& d) {
+  int first_sign = Sign(a) * Sign(b);
+  int second_sign = Sign(c) * Sign(d);
+  if (first_sign != second_sign) {
+    return first_sign > second_sign ? 1 : -1;
+  }
+  if (first_sign == 0) {
+    return 0;
+  }
+
+  Int256 first_high;
+  Int256 first_low;
+  Int256 second_high;
+  Int256 second_low;
+  MultiplyWide(Magnitude(a), Magnitude(b), &first_high, &first_low);
+  MultiplyWide(Magnitude(c), Magnitude(d), &second_high, &second_low);
+
+  int magnitude_order = CompareMagnitudes(first_high, second_high);
+  if (magnitude_order == 0) {
+    magnitude_order = CompareMagnitudes(first_low, second_low);
+  }
+  return first_sign * magnitude_order;
 }
 
-// ---------------------------------> Segment <---------------------------------
+// Quotient rounded up for integers; plain quotient for floating point.
+template <class N>
+N DivideUp(N value, N divisor) {
+  if constexpr (std::is_floating_point_v<N>) {
+    return value / divisor;
+  } else {
+    return (value + divisor - 1) / divisor;
+  }
+}
 
-Segment::Segment(const Point& begin, const Point& end)
-    : begin_(begin), end_(end) {}
+// Quotient and remainder of high * 2^128 + low by divisor, which must be
+// greater than high, by shifting in one bit at a time unless high is zero.
+inline void DivideWide(unsigned __int128 high, unsigned __int128 low,
+                       unsigned __int128 divisor, unsigned __int128* quotient,
+                       unsigned __int128* remainder) {
+  if (high == 0) {
+    *quotient = low / divisor;
+    *remainder = low % divisor;
+    return;
+  }
 
-IShape& Segment::Move(const Vector& shift) {
-  begin_.Move(shift);
-  end_.Move(shift);
-  return *this;
+  *quotient = 0;
+  for (int bit = 127; bit >= 0; --bit) {
+    bool carry = (high >> 127) != 0;
+    high = (high << 1) | ((low >> bit) & 1);
+    *quotient <<= 1;
+    if (carry || high >= divisor) {
+      high -= divisor;
+      *quotient |= 1;
+    }
+  }
+  *remainder = high;
 }
 
-bool Segment::ContainsPoint(const Point& other) const {
-  Line temp(begin_, end_);
-  return (temp.ContainsPoint(other) &&
-          (other.point.x >= std::min(begin_.point.x, end_.point.x) &&
-           other.point.x <= std::max(begin_.point.x, end_.point.x)) &&
-          (other.point.y >= std::min(begin_.point.y, end_.point.y) &&
-           other.point.y <= std::max(begin_.point.y, end_.point.y)));
+// Largest m with m * m <= a * b for a, b >= 0: a long double estimate, then a
+// binary search on exact products around it.
+inline __int128 FloorSqrtProduct(__int128 a, __int128 b) {
+  long double estimate = std::sqrt(static_cast<long double>(a)) *
+                         std::sqrt(static_cast<long double>(b));
+  __int128 guess = static_cast<__int128>(estimate);
+  __int128 slack = static_cast<__int128>(estimate * 0x1p-60L) + 2;
+
+  __int128 low = std::max<__int128>(guess - slack, 0);
+  while (low > 0 && CompareProducts(low, low, a, b) > 0) {
+    low /= 2;
+  }
+  __int128 high = guess + slack;
+  while (CompareProducts(high, high, a, b) <= 0) {
+    high = 2 * high + 1;
+  }
+  while (high - low > 1) {
+    __int128 middle = low + (high - low) / 2;
+    if (CompareProducts(middle, middle, a, b) <= 0) {
+      low = middle;
+    } else {
+      high = middle;
+    }
+  }
+  return low;
 }
 
-bool Segment::CrossesSegment(const Segment& other) const {
-  auto borders = other.GetBorders();
-  long long first_result = ((end_ - begin_) ^ (borders.first - begin_)) *
-                           ((end_ - begin_) ^ (borders.second - begin_));
-  long long second_result =
-      ((borders.second - borders.first) ^ (begin_ - borders.first)) *
-      ((borders.second - borders.first) ^ (end_ - borders.first));
-  return (first_result < 0 && second_result < 0) ||
-         this->ContainsPoint(borders.first) ||
-         this->ContainsPoint(borders.second) || other.ContainsPoint(begin_) ||
-         other.ContainsPoint(end_);
+// Unsigned 512-bit division as above, one bit at a time.
+inline void DivideWide(Int256 high, const Int256& low, const Int256& divisor,
+                       Int256* quotient, Int256* remainder) {
+  *quotient = Int256();
+  for (int bit = 255; bit >= 0; --bit) {
+    unsigned __int128 next = bit >= 128 ? low.high >> (bit - 128)
+                                        : low.low >> bit;
+    bool carry = (high.high >> 127) != 0;
+    high = Int256((high.high << 1) | (high.low >> 127),
+                  (high.low << 1) | (next & 1));
+    *quotient = Int256((quotient->high << 1) | (quotient->low >> 127),
+                       quotient->low << 1);
+    if (carry || CompareMagnitudes(high, divisor) >= 0) {
+      high -= divisor;
+      quotient->low |= 1;
+    }
+  }
+  *remainder = high;
 }
 
-IShape* Segment::Clone() const { return new Segment(begin_, end_); }
+// Largest m with m * m <= a * b for a, b >= 0 and a * b < 2^508, found one
+// bit at a time.
+inline Int256 FloorSqrtProduct(const Int256& a, const Int256& b) {
+  Int256 root;
+  for (int bit = 253; bit >= 0; --bit) {
+    Int256 candidate =
+        bit >= 128 ? Int256(root.high | (static_cast<unsigned __int128>(1)
+                                         << (bit - 128)),
+                            root.low)
+                   : Int256(root.high,
+                            root.low | (static_cast<unsigned __int128>(1)
+                                        << bit));
+    if (CompareProducts(candidate, candidate, a, b) <= 0) {
+      root = candidate;
+    }
+  }
+  return root;
+}
 
-std::string Segment::ToString() {
-  std::ostringstream string_stream;
-  string_stream << "Segment(" << begin_.ToString() << ", " << end_.ToString()
-                << ")";
-  return string_stream.str();
+// --------------------------------> Distance <--------------------------------
+
+template <class T>
+BasicDistance2<T>::BasicDistance2(Exact whole) : whole(whole) {}
+
+template <class T>
+BasicDistance2<T> BasicDistance2<T>::SquareOver(Exact numerator,
+                                                Exact denominator) {
+  if constexpr (std::is_floating_point_v<Exact>) {
+    return BasicDistance2(numerator * numerator / denominator);
+  } else {
+    using Unsigned = decltype(Magnitude(numerator));
+    Unsigned high = 0;
+    Unsigned low = 0;
+    Unsigned quotient = 0;
+    Unsigned remainder = 0;
+    MultiplyWide(Magnitude(numerator), Magnitude(numerator), &high, &low);
+    DivideWide(high, low, denominator, &quotient, &remainder);
+
+    BasicDistance2 result(static_cast<Exact>(quotient));
+    result.remainder = static_cast<Exact>(remainder);
+    result.denominator = denominator;
+    return result;
+  }
 }
 
-std::pair<Point, Point> Segment::GetBorders() const {
-  return std::pair<Point, Point>(begin_, end_);
+template <class T>
+double BasicDistance2<T>::ToDouble() const {
+  return static_cast<double>(whole) +
+         static_cast<double>(remainder) / static_cast<double>(denominator);
 }
 
-// ---------------------------------> Ray <---------------------------------
+template <class T>
+std::strong_ordering operator<=>(const BasicDistance2<T>& first,
+                                 const BasicDistance2<T>& second) {
+  int order = first.whole != second.whole
+                  ? (first.whole < second.whole ? -1 : 1)
+                  : CompareProducts(first.remainder, second.denominator,
+                                    second.remainder, first.denominator);
+  return order <=> 0;
+}
 
-Ray::Ray(const Point& begin, const Point& end) : begin_(begin) {
-  direction_ = end.point - begin.point;
+template <class T>
+bool operator==(const BasicDistance2<T>& first,
+                const BasicDistance2<T>& second) {
+  return (first <=> second) == 0;
 }
 
-Ray::Ray(const Point& begin, const Vector& dir)
-    : begin_(begin), direction_(dir) {}
+// ---------------------------------> Text <---------------------------------
 
-IShape& Ray::Move(const Vector& shift) {
-  begin_.Move(shift);
-  return *this;
+// The helpers below pass nullptr through, so that calls can be chained and
+// checked once at the end.
+
+inline char* AppendText(char* first, char* last, const char* text) {
+  size_t length = std::strlen(text);
+  if (first == nullptr || static_cast<size_t>(last - first) < length) {
+    return nullptr;
+  }
+  std::memcpy(first, text, length);
+  return first + length;
 }
 
-bool Ray::ContainsPoint(const Point& other) const {
-  Line temp(begin_, begin_.point + direction_);
-  return (temp.ContainsPoint(other) && ((other - begin_) * direction_) >= 0);
+template <class N>
+char* AppendNumber(char* first, char* last, N value) {
+  if (first == nullptr) {
+    return nullptr;
+  }
+  auto [end, error] = std::to_chars(first, last, value);
+  return error == std::errc() ? end : nullptr;
 }
 
-bool Ray::CrossesSegment(const Segment& other) const {
-  auto borders = other.GetBorders();
-  if (ContainsPoint(borders.first) || ContainsPoint(borders.second)) {
-    return true;
+inline char* AppendNumber(char* first, char* last, __int128 value) {
+  char digits[40];
+  char* begin = digits + sizeof(digits);
+  unsigned __int128 rest = Magnitude(value);
+
+  do {
+    *--begin = static_cast<char>('0' + static_cast<int>(rest % 10));
+    rest /= 10;
+  } while (rest != 0);
+  if (value < 0) {
+    *--begin = '-';
   }
 
-  return ((borders.first - begin_) ^ direction_) *
-                 ((borders.second - begin_) ^ direction_) <
-             0 &&
-         !Line(begin_, borders.first)
-              .CrossesSegment(Segment((borders.second),
-                                      Point(begin_.point.x + direction_.x,
-                                            begin_.point.y + direction_.y)));
+  size_t length = digits + sizeof(digits) - begin;
+  if (first == nullptr || static_cast<size_t>(last - first) < length) {
+    return nullptr;
+  }
+  std::memcpy(first, begin, length);
+  return first + length;
 }
 
-IShape* Ray::Clone() const { return new Ray(*this); }
+inline char* AppendNumber(char* first, char* last, const Int256& value) {
+  char digits[80];
+  char* begin = digits + sizeof(digits);
+  Int256 rest = Magnitude(value);
+
+  do {
+    unsigned __int128 low = 0;
+    unsigned __int128 digit = 0;
+    DivideWide(rest.high % 10, rest.low, 10, &low, &digit);
+    rest = Int256(rest.high / 10, low);
+    *--begin = static_cast<char>('0' + static_cast<int>(digit));
+  } while (rest != 0);
+  if (value < 0) {
+    *--begin = '-';
+  }
 
-std::string Ray::ToString() {
-  std::ostringstream string_stream;
-  string_stream << "Ray(" << begin_.ToString() << ", " << direction_.ToString()
-                << ")";
-  return string_stream.str();
+  size_t length = digits + sizeof(digits) - begin;
+  if (first == nullptr || static_cast<size_t>(last - first) < length) {
+    return nullptr;
+  }
+  std::memcpy(first, begin, length);
+  return first + length;
 }
 
-// ---------------------------------> Line <---------------------------------
+// Grows the buffer until the whole text fits.
+template <class Shape>
+std::string AppendToString(const Shape& shape) {
+  std::string text(64, '\0');
+  while (true) {
+    char* end = shape.AppendTo(text.data(), text.data() + text.size());
+    if (end != nullptr) {
+      text.resize(end - text.data());
+      return text;
+    }
+    text.resize(2 * text.size());
+  }
+}
 
-Line::Line(const Point& begin, const Point& end) : first_(begin), second_(end) {
-  a_ = end.point.y - begin.point.y;  // y2 - y1
-  b_ = begin.point.x - end.point.x;  // x1 - x2
-  c_ = begin.point.x * (begin.point.y - end.point.y) +
-       begin.point.y * (end.point.x - begin.point.x);
-  // x1 * (y1 - y2) + y1 * (x2 - x1)
+inline const char* SkipSpaces(const char* first, const char* last) {
+  if (first == nullptr) {
+    return nullptr;
+  }
+  while (first != last && (*first == ' ' || *first == '\t' ||
+                            *first == '\n' || *first == '\r')) {
+    ++first;
+  }
+  return first;
 }
 
-IShape& Line::Move(const Vector& shift) {
-  c_ -= (a_ * shift.x + b_ * shift.y);
-  return *this;
+inline const char* ParseText(const char* first, const char* last,
+                             const char* text) {
+  first = SkipSpaces(first, last);
+  if (first == nullptr) {
+    return nullptr;
+  }
+  size_t length = std::strlen(text);
+  if (static_cast<size_t>(last - first) < length ||
+      std::memcmp(first, text, length) != 0) {
+    return nullptr;
+  }
+  return first + length;
 }
 
-bool Line::ContainsPoint(const Point& other) const {
-  return (a_ * other.point.x + b_ * other.point.y + c_ == 0);
+// Decimal integers with an optional minus are read by hand, failing on
+// overflow; floating point numbers are read by from_chars.
+template <class N>
+const char* ParseNumber(const char* first, const char* last, N* value) {
+  first = SkipSpaces(first, last);
+  if (first == nullptr) {
+    return nullptr;
+  }
+  if constexpr (std::is_floating_point_v<N>) {
+    auto [end, error] = std::from_chars(first, last, *value);
+    return error == std::errc() ? end : nullptr;
+  } else {
+    using Unsigned = std::make_unsigned_t<N>;
+    bool negative = first != last && *first == '-';
+    first += negative;
+    const Unsigned limit =
+        static_cast<Unsigned>(std::numeric_limits<N>::max()) + negative;
+    const char* digits = first;
+    Unsigned result = 0;
+    for (; first != last && *first >= '0' && *first <= '9'; ++first) {
+      Unsigned digit = *first - '0';
+      if (result > (limit - digit) / 10) {
+        return nullptr;
+      }
+      result = result * 10 + digit;
+    }
+    if (first == digits) {
+      return nullptr;
+    }
+    *value = static_cast<N>(negative ? Unsigned(0) - result : result);
+    return first;
+  }
 }
 
-bool Line::CrossesSegment(const Segment& other) const {
-  auto borders = other.GetBorders();
+// ---------------------------------> Kernels <---------------------------------
 
-  Vector direction = second_ - first_;
-  Vector first = borders.first - first_;
-  Vector second = borders.second - first_;
+// Difference of two vectors, widened so that products of its components
+// are exact.
+template <class T, class Wide = typename CoordTraits<T>::Wide,
+          class Exact = typename CoordTraits<T>::Exact>
+struct Delta {
+  Delta(const BasicVector<T>& to, const BasicVector<T>& from)
+      : x(static_cast<Wide>(to.x) - from.x),
+        y(static_cast<Wide>(to.y) - from.y) {}
+  explicit Delta(const BasicVector<T>& vec) : x(vec.x), y(vec.y) {}
 
-  return ((direction ^ first) * (direction ^ second)) <= 0;
-}
+  Exact operator^(const Delta& other) const {
+    return static_cast<Exact>(x) * other.y - static_cast<Exact>(y) * other.x;
+  }
+  Exact operator*(const Delta& other) const {
+    return static_cast<Exact>(x) * other.x + static_cast<Exact>(y) * other.y;
+  }
 
-IShape* Line::Clone() const { return new Line(*this); }
+  Wide x;
+  Wide y;
+};
 
-std::string Line::ToString() {
-  std::ostringstream string_stream;
-  string_stream << "Line(" << a_ << ", " << b_ << ", " << c_ << ")";
-  return string_stream.str();
+// Whether every value is below 2^30 in magnitude. Differences of such
+// values take 31 bits and sums of two products of differences 63, so the
+// batch kernels can run in long long lanes, which vectorize, rather than in
+// __int128, which does not.
+template <class T>
+bool FitsLanes(const T* values, size_t n) {
+  if constexpr (std::is_integral_v<T>) {
+    const T kLimit = T(1) << 30;
+    T low = 0;
+    T high = 0;
+    for (size_t i = 0; i < n; ++i) {
+      low = std::min(low, values[i]);
+      high = std::max(high, values[i]);
+    }
+    return low > -kLimit && high < kLimit;
+  } else {
+    return false;
+  }
 }
 
-// ---------------------------------> Circle <---------------------------------
+template <class T>
+bool FitsLanes(std::initializer_list<T> values) {
+  return FitsLanes(values.begin(), values.size());
+}
 
-static int LinearEquation(double k, double b, double* x) {
-  if (k == 0) {
-    return -1;
+// Calls kernel(std::type_identity<D>()), where D is Delta<T> in long long
+// lanes if fits and the exact Delta<T> otherwise.
+template <class T, class Kernel>
+inline void RunKernel(bool fits, const Kernel& kernel) {
+  if constexpr (std::is_integral_v<T>) {
+    if (fits) {
+      kernel(std::type_identity<Delta<T, long long, long long>>());
+      return;
+    }
   }
+  kernel(std::type_identity<Delta<T>>());
+}
 
-  *x = -b / k;
+// Sign of (second - origin) ^ (third - origin).
+template <class T>
+int Orientation(const BasicVector<T>& origin, const BasicVector<T>& second,
+                const BasicVector<T>& third) {
+  return Sign(Delta<T>(second, origin) ^ Delta<T>(third, origin));
+}
 
-  return 1;
+template <class T>
+bool OnSegment(const BasicVector<T>& begin, const BasicVector<T>& end,
+               const BasicVector<T>& point) {
+  return Orientation(begin, end, point) == 0 &&
+         point.x >= std::min(begin.x, end.x) &&
+         point.x <= std::max(begin.x, end.x) &&
+         point.y >= std::min(begin.y, end.y) &&
+         point.y <= std::max(begin.y, end.y);
 }
 
-static int SquareEquat(double a, double b, double c, double* x1, double* x2) {
-  if (a == 0) {
-    return LinearEquation(b, c, x1);
-  }
+template <class T>
+bool SegmentsCross(const BasicVector<T>& first_begin,
+                   const BasicVector<T>& first_end,
+                   const BasicVector<T>& second_begin,
+                   const BasicVector<T>& second_end) {
+  int first_result = Orientation(first_begin, first_end, second_begin) *
+                     Orientation(first_begin, first_end, second_end);
+  int second_result = Orientation(second_begin, second_end, first_begin) *
+                      Orientation(second_begin, second_end, first_end);
+  return (first_result < 0 && second_result < 0) ||
+         OnSegment(first_begin, first_end, second_begin) ||
+         OnSegment(first_begin, first_end, second_end) ||
+         OnSegment(second_begin, second_end, first_begin) ||
+         OnSegment(second_begin, second_end, first_end);
+}
 
-  double d = (b * b) - (4 * a * c);
-  if (d < 0) {
-    return -1;
+// A segment meets a closed box iff their bounding boxes meet and the corners
+// of the box are not all strictly on one side of the segment's line.
+template <class T>
+bool SegmentMeetsBox(const BasicVector<T>& begin, const BasicVector<T>& end,
+                     const BasicBox<T>& box) {
+  if (!BasicBox<T>::Of(begin, end).Intersects(box)) {
+    return false;
   }
 
-  double cached_sqrt = std::sqrt(d);
-
-  *x1 = (-b + cached_sqrt) / (2 * a);
-  *x2 = (-b - cached_sqrt) / (2 * a);
-
-  return 2;
+  int sides[4] = {
+      Orientation(begin, end, BasicVector<T>(box.min_x, box.min_y)),
+      Orientation(begin, end, BasicVector<T>(box.max_x, box.min_y)),
+      Orientation(begin, end, BasicVector<T>(box.min_x, box.max_y)),
+      Orientation(begin, end, BasicVector<T>(box.max_x, box.max_y))};
+  bool all_above = true;
+  bool all_below = true;
+  for (int side : sides) {
+    all_above = all_above && side > 0;
+    all_below = all_below && side < 0;
+  }
+  return !all_above && !all_below;
 }
 
-Circle::Circle(const Point& k_center, int radius)
-    : center_(k_center), radius_(radius) {}
+// Range of x over the part of the segment with y in [min_y, max_y], which
+// must meet the segment's y range. Found in floating point and widened by a
+// bound on the rounding, so it may be a little too wide but never too narrow.
+template <class T>
+std::pair<T, T> SegmentSpan(const BasicVector<T>& begin,
+                            const BasicVector<T>& end, T min_y, T max_y) {
+  using Wide = typename CoordTraits<T>::Wide;
+
+  T low = std::min(begin.x, end.x);
+  T high = std::max(begin.x, end.x);
+  if (begin.y == end.y) {
+    return {low, high};
+  }
 
-IShape& Circle::Move(const Vector& shift) {
-  center_.Move(shift);
-  return *this;
+  double dx = static_cast<double>(static_cast<Wide>(end.x) - begin.x);
+  double dy = static_cast<double>(static_cast<Wide>(end.y) - begin.y);
+  double slack = std::abs(dx) * 0x1p-48 + 1;
+  auto offset_at = [&](T y) {
+    double t = static_cast<double>(static_cast<Wide>(y) - begin.y) / dy;
+    return std::clamp(t, 0.0, 1.0) * dx;
+  };
+  auto x_at = [&](double offset) {
+    Wide x = begin.x + static_cast<Wide>(offset);
+    return static_cast<T>(
+        std::clamp(x, static_cast<Wide>(low), static_cast<Wide>(high)));
+  };
+
+  double first = offset_at(min_y);
+  double second = offset_at(max_y);
+  return {x_at(std::min(first, second) - slack),
+          x_at(std::max(first, second) + slack)};
 }
 
-bool Circle::ContainsPoint(const Point& other) const {
-  return (other.point.x - center_.point.x) * (other.point.x - center_.point.x) +
-             (other.point.y - center_.point.y) *
-                 (other.point.y - center_.point.y) <=
-         radius_ * radius_;
+template <class T>
+bool RayContainsPoint(const BasicVector<T>& origin,
+                      const BasicVector<T>& direction,
+                      const BasicVector<T>& point) {
+  Delta<T> ray(direction);
+  Delta<T> offset(point, origin);
+  return (ray ^ offset) == 0 && (ray * offset) >= 0;
 }
 
-bool Circle::CrossesSegment(const Segment& other) const {
-  auto borders = other.GetBorders();
-  long long x1 = borders.first.point.x;
-  long long x2 = borders.second.point.x;
-  long long y1 = borders.first.point.y;
-  long long y2 = borders.second.point.y;
+// The segment's line meets the ray's line at origin + t * direction with
+// t = -((end - begin) ^ (origin - begin)) / ((end - begin) ^ direction); the
+// ray crosses the segment when the ends are on opposite sides and t >= 0.
+template <class T>
+bool RayCrossesSegment(const BasicVector<T>& origin,
+                       const BasicVector<T>& direction,
+                       const BasicVector<T>& begin, const BasicVector<T>& end) {
+  if (RayContainsPoint(origin, direction, begin) ||
+      RayContainsPoint(origin, direction, end)) {
+    return true;
+  }
+
+  Delta<T> ray(direction);
+  if (Sign(ray ^ Delta<T>(begin, origin)) * Sign(ray ^ Delta<T>(end, origin)) >=
+      0) {
+    return false;
+  }
 
-  long long a = (x2 - x1) * (x2 - x1) + (y2 - y1) * (y2 - y1);
-  long long b = 2 * (x2 - x1) * x1 + 2 * (y2 - y1) * y1 -
-                2 * center_.point.x * (x2 - x1) -
-                2 * center_.point.y * (y2 - y1);
-  long long c = x1 * x1 + y1 * y1 - 2 * x1 * center_.point.x -
-                2 * y1 * center_.point.y + center_.point.x * center_.point.x +
-                center_.point.y * center_.point.y - radius_ * radius_;
+  Delta<T> edge(end, begin);
+  Delta<T> start(origin, begin);
+  return Sign(edge ^ start) * Sign(edge ^ ray) <= 0;
+}
 
-  double p1 = -1;
-  double p2 = -1;
+// Squared distance from the point to the closed box.
+template <class T>
+typename CoordTraits<T>::Exact BoxDistance2(const BasicBox<T>& box,
+                                            const BasicVector<T>& point) {
+  using Wide = typename CoordTraits<T>::Wide;
+  using Exact = typename CoordTraits<T>::Exact;
+
+  Wide dx = std::max({static_cast<Wide>(box.min_x) - point.x,
+                      static_cast<Wide>(point.x) - box.max_x, Wide(0)});
+  Wide dy = std::max({static_cast<Wide>(box.min_y) - point.y,
+                      static_cast<Wide>(point.y) - box.max_y, Wide(0)});
+  return static_cast<Exact>(dx) * dx + static_cast<Exact>(dy) * dy;
+}
 
-  int answer = SquareEquat(a, b, c, &p1, &p2);
-  if (answer == 2) {
-    return (p1 >= 0. && p1 <= 1.) || (p2 >= 0. && p2 <= 1.);
+// The nearest point of the segment is an end when the projection of the
+// point falls outside of it; otherwise the distance is the one to the line,
+// ((end - begin) ^ (point - begin))^2 / |end - begin|^2.
+template <class T>
+BasicDistance2<T> SegmentDistance2(const BasicVector<T>& begin,
+                                   const BasicVector<T>& end,
+                                   const BasicVector<T>& point) {
+  Delta<T> direction(end, begin);
+  Delta<T> to_begin(point, begin);
+  auto projection = direction * to_begin;
+  if (projection <= 0) {
+    return BasicDistance2<T>(to_begin * to_begin);
   }
-  if (answer == 1) {
-    return (p1 >= 0. && p1 <= 1.);
+  auto length2 = direction * direction;
+  if (projection >= length2) {
+    Delta<T> to_end(point, end);
+    return BasicDistance2<T>(to_end * to_end);
   }
-  return false;
+  return BasicDistance2<T>::SquareOver(direction ^ to_begin, length2);
 }
 
-IShape* Circle::Clone() const { return new Circle(*this); }
+// Best-first walk over a tree of boxes laid out like the polygon edge index:
+// calls visit(j) for every leaf j whose box is at a distance from the point
+// that accept(distance) takes, nearer children first. Empty boxes are
+// skipped.
+template <class T, class Accept, class Visitor>
+void VisitNearestLeaves(const std::vector<BasicBox<T>>& tree, size_t leaves,
+                        const BasicVector<T>& point, Accept accept,
+                        Visitor visit) {
+  using Exact = typename CoordTraits<T>::Exact;
+
+  if (tree.empty()) {
+    return;
+  }
+  auto is_empty = [&](size_t node) {
+    return tree[node].min_x > tree[node].max_x;
+  };
+
+  std::pair<size_t, Exact> stack[2 * std::numeric_limits<size_t>::digits];
+  size_t top = 0;
+  stack[top++] = {1, BoxDistance2(tree[1], point)};
+
+  while (top > 0) {
+    auto [node, distance] = stack[--top];
+    if (!accept(BasicDistance2<T>(distance))) {
+      continue;
+    }
+    if (node >= leaves) {
+      visit(node - leaves);
+      continue;
+    }
 
-std::string Circle::ToString() {
-  std::ostringstream string_stream;
-  string_stream << "Circle(" << center_.ToString() << ", " << radius_ << ")";
-  return string_stream.str();
+    size_t near = 2 * node;
+    size_t far = 2 * node + 1;
+    if (is_empty(far)) {
+      stack[top++] = {near, BoxDistance2(tree[near], point)};
+      continue;
+    }
+    Exact near_distance = BoxDistance2(tree[near], point);
+    Exact far_distance = BoxDistance2(tree[far], point);
+    if (far_distance < near_distance) {
+      std::swap(near, far);
+      std::swap(near_distance, far_distance);
+    }
+    stack[top++] = {far, far_distance};
+    stack[top++] = {near, near_distance};
+  }
 }
 
-// ---------------------------------> Polygon <---------------------------------
+// ---------------------------------> Vector <---------------------------------
 
-Polygon::Polygon(const std::vector<Point>& vertexes) : vertexes_(vertexes) {}
+template <class T>
+BasicVector<T>::BasicVector(T x, T y) : x(x), y(y) {}
 
-IShape& Polygon::Move(const Vector& shift) {
-  for (auto it = vertexes_.begin(); it != vertexes_.end(); ++it) {
-    it->Move(shift);
-  }
+template <class T>
+BasicVector<T>& BasicVector<T>::operator+=(const BasicVector& other) {
+  x += other.x;
+  y += other.y;
+  return *this;
+}
 
+template <class T>
+BasicVector<T>& BasicVector<T>::operator-=(const BasicVector& other) {
+  x -= other.x;
+  y -= other.y;
   return *this;
 }
 
-bool Polygon::ContainsPoint(const Point& other) const {
-  size_t size = vertexes_.size();
+template <class T>
+BasicVector<T>& BasicVector<T>::operator*=(T num) {
+  x *= num;
+  y *= num;
+  return *this;
+}
 
-  for (size_t i = 0; i < size; ++i) {
-    if (Segment(vertexes_[i], vertexes_[(i + 1) % size]).ContainsPoint(other)) {
-      return true;
-    }
-  }
+template <class T>
+BasicVector<T>& BasicVector<T>::operator-() {
+  return (*this *= -1);
+}
+
+template <class T>
+typename CoordTraits<T>::Wide operator*(const BasicVector<T>& first,
+                                        const BasicVector<T>& second) {
+  using Wide = typename CoordTraits<T>::Wide;
+  return static_cast<Wide>(first.x) * second.x +
+         static_cast<Wide>(first.y) * second.y;
+}
 
-  bool is_found = false;
-  int count = 0;
-  Ray ray;
+template <class T>
+BasicVector<T> operator+(const BasicVector<T>& first,
+                         const BasicVector<T>& second) {
+  BasicVector<T> temp(first);
+  temp += second;
+  return temp;
+}
 
-  while (!is_found) {
-    Vector rand_dir(rand() % 80 + 1, rand() % 80 + 1);
-    ray = Ray(other, rand_dir);
-    is_found = true;
-    for (auto it = vertexes_.begin(); it != vertexes_.end(); ++it) {
-      if (ray.ContainsPoint(*it)) {
-        is_found = false;
-      }
-    }
-  }
+template <class T>
+BasicVector<T> operator-(const BasicVector<T>& first,
+                         const BasicVector<T>& second) {
+  BasicVector<T> temp(first);
+  temp -= second;
+  return temp;
+}
 
-  for (size_t i = 0; i < size; ++i) {
-    if (ray.CrossesSegment(Segment(vertexes_[i], vertexes_[(i + 1) % size]))) {
-      ++count;
-    }
-  }
+template <class T>
+typename CoordTraits<T>::Wide operator^(const BasicVector<T>& first,
+                                        const BasicVector<T>& second) {
+  using Wide = typename CoordTraits<T>::Wide;
+  return static_cast<Wide>(first.x) * second.y -
+         static_cast<Wide>(second.x) * first.y;
+}
+
+template <class T>
+BasicVector<T> operator*(const BasicVector<T>& vec,
+                         std::type_identity_t<T> num) {
+  BasicVector<T> temp(vec);
+  temp *= num;
+  return temp;
+}
 
-  return (bool)(count % 2);
+template <class T>
+BasicVector<T> operator*(std::type_identity_t<T> num,
+                         const BasicVector<T>& vec) {
+  return (vec * num);
 }
 
-bool Polygon::CrossesSegment(const Segment& other) const {
-  for (size_t i = 0; i < vertexes_.size() - 1; ++i) {
-    Segment temp(vertexes_[i], vertexes_[i + 1]);
-    if (temp.CrossesSegment(other)) {
-      return true;
-    }
-  }
+template <class T>
+bool operator==(const BasicVector<T>& first, const BasicVector<T>& second) {
+  return (first.x == second.x && first.y == second.y);
+}
 
-  return false;
+template <class T>
+std::string BasicVector<T>::ToString() {
+  return AppendToString(*this);
 }
 
-IShape* Polygon::Clone() const { return new Polygon(*this); }
+template <class T>
+char* BasicVector<T>::AppendTo(char* first, char* last) const {
+  first = AppendText(first, last, "Vector(");
+  first = AppendNumber(first, last, x);
+  first = AppendText(first, last, ", ");
+  first = AppendNumber(first, last, y);
+  return AppendText(first, last, ")");
+}
 
-std::string Polygon::ToString() {
-  std::ostringstream string_stream;
-  string_stream << "Polygon(";
+// ---------------------------------> IShape <---------------------------------
 
-  for (size_t i = 0; i < vertexes_.size() - 1; ++i) {
-    string_stream << vertexes_[i].ToString() << ", ";
+template <class T>
+void BasicIShape<T>::ContainsPoints(const T* xs, const T* ys, size_t n,
+                                    uint8_t* out) const {
+  for (size_t i = 0; i < n; ++i) {
+    out[i] = static_cast<uint8_t>(ContainsPoint(BasicPoint<T>(xs[i], ys[i])));
   }
-  string_stream << vertexes_[vertexes_.size() - 1].ToString() << ")";
+}
+
+// ---------------------------------> Point <---------------------------------
 
-  return string_stream.str();
+template <class T>
+BasicPoint<T>::BasicPoint(const BasicVector<T>& point) : point(point) {}
+
+template <class T>
+BasicPoint<T>::BasicPoint(T x, T y) : point(x, y) {}
+
+template <class T>
+BasicIShape<T>& BasicPoint<T>::Move(const BasicVector<T>& shift) {
+  point += shift;
+  return *this;
+}
+
+template <class T>
+bool BasicPoint<T>::ContainsPoint(const BasicPoint& other) const {
+  return point == other.point;
+}
+
+template <class T>
+bool BasicPoint<T>::CrossesSegment(const BasicSegment<T>& other) const {
+  return other.ContainsPoint(*this);
+}
+
+template <class T>
+BasicDistance2<T> BasicPoint<T>::SquaredDistance(
+    const BasicPoint& other) const {
+  Delta<T> offset(other.point, point);
+  return BasicDistance2<T>(offset * offset);
+}
+
+template <class T>
+BasicIShape<T>* BasicPoint<T>::Clone() const {
+  return new BasicPoint(*this);
+}
+
+template <class T>
+std::string BasicPoint<T>::ToString() {
+  return AppendToString(*this);
+}
+
+template <class T>
+char* BasicPoint<T>::AppendTo(char* first, char* last) const {
+  first = AppendText(first, last, "Point(");
+  first = AppendNumber(first, last, point.x);
+  first = AppendText(first, last, ", ");
+  first = AppendNumber(first, last, point.y);
+  return AppendText(first, last, ")");
+}
+
+template <class T>
+BasicVector<T> operator-(const BasicPoint<T>& first,
+                         const BasicPoint<T>& second) {
+  return first.point - second.point;
+}
+
+template <class T>
+void BasicPoint<T>::ContainsPoints(const T* xs, const T* ys, size_t n,
+                                   uint8_t* out) const {
+  const T x = point.x;
+  const T y = point.y;
+
+  for (size_t i = 0; i < n; ++i) {
+    out[i] = static_cast<uint8_t>((xs[i] == x) & (ys[i] == y));
+  }
+}
+
+// ---------------------------------> Segment <---------------------------------
+
+template <class T>
+BasicSegment<T>::BasicSegment(const BasicPoint<T>& begin,
+                              const BasicPoint<T>& end)
+    : begin_(begin), end_(end) {}
+
+template <class T>
+BasicIShape<T>& BasicSegment<T>::Move(const BasicVector<T>& shift) {
+  begin_.point += shift;
+  end_.point += shift;
+  return *this;
+}
+
+template <class T>
+bool BasicSegment<T>::ContainsPoint(const BasicPoint<T>& other) const {
+  return OnSegment(begin_.point, end_.point, other.point);
+}
+
+template <class T>
+bool BasicSegment<T>::CrossesSegment(const BasicSegment& other) const {
+  auto borders = other.GetBorders();
+  return SegmentsCross(begin_.point, end_.point, borders.first.point,
+                       borders.second.point);
+}
+
+template <class T>
+BasicDistance2<T> BasicSegment<T>::SquaredDistance(
+    const BasicPoint<T>& other) const {
+  return SegmentDistance2(begin_.point, end_.point, other.point);
+}
+
+template <class T>
+BasicIShape<T>* BasicSegment<T>::Clone() const {
+  return new BasicSegment(begin_, end_);
+}
+
+template <class T>
+std::string BasicSegment<T>::ToString() {
+  return AppendToString(*this);
+}
+
+template <class T>
+char* BasicSegment<T>::AppendTo(char* first, char* last) const {
+  first = AppendText(first, last, "Segment(");
+  first = begin_.AppendTo(first, last);
+  first = AppendText(first, last, ", ");
+  first = end_.AppendTo(first, last);
+  return AppendText(first, last, ")");
+}
+
+template <class T>
+std::pair<BasicPoint<T>, BasicPoint<T>> BasicSegment<T>::GetBorders() const {
+  return std::pair<BasicPoint<T>, BasicPoint<T>>(begin_, end_);
+}
+
+template <class T>
+void BasicSegment<T>::ContainsPoints(const T* xs, const T* ys, size_t n,
+                                     uint8_t* out) const {
+  const BasicVector<T> begin = begin_.point;
+  const BasicVector<T> end = end_.point;
+  const T min_x = std::min(begin.x, end.x);
+  const T max_x = std::max(begin.x, end.x);
+  const T min_y = std::min(begin.y, end.y);
+  const T max_y = std::max(begin.y, end.y);
+
+  bool fits = FitsLanes({begin.x, begin.y, end.x, end.y}) &&
+              FitsLanes(xs, n) && FitsLanes(ys, n);
+  RunKernel<T>(fits, [&](auto lanes) {
+    using Lanes = typename decltype(lanes)::type;
+    const Lanes direction(end, begin);
+    for (size_t i = 0; i < n; ++i) {
+      auto cross = direction ^ Lanes(BasicVector<T>(xs[i], ys[i]), begin);
+      out[i] = static_cast<uint8_t>((cross == 0) & (xs[i] >= min_x) &
+                                    (xs[i] <= max_x) & (ys[i] >= min_y) &
+                                    (ys[i] <= max_y));
+    }
+  });
+}
+
+// ---------------------------------> Ray <---------------------------------
+
+template <class T>
+BasicRay<T>::BasicRay(const BasicPoint<T>& begin, const BasicPoint<T>& end)
+    : begin_(begin) {
+  direction_ = end.point - begin.point;
+}
+
+template <class T>
+BasicRay<T>::BasicRay(const BasicPoint<T>& begin, const BasicVector<T>& dir)
+    : begin_(begin), direction_(dir) {}
+
+template <class T>
+BasicIShape<T>& BasicRay<T>::Move(const BasicVector<T>& shift) {
+  begin_.point += shift;
+  return *this;
+}
+
+template <class T>
+bool BasicRay<T>::ContainsPoint(const BasicPoint<T>& other) const {
+  return RayContainsPoint(begin_.point, direction_, other.point);
+}
+
+template <class T>
+bool BasicRay<T>::CrossesSegment(const BasicSegment<T>& other) const {
+  auto borders = other.GetBorders();
+  return RayCrossesSegment(begin_.point, direction_, borders.first.point,
+                           borders.second.point);
+}
+
+// A ray without a direction contains every point, as in ContainsPoint.
+template <class T>
+BasicDistance2<T> BasicRay<T>::SquaredDistance(
+    const BasicPoint<T>& other) const {
+  Delta<T> direction(direction_);
+  Delta<T> offset(other.point, begin_.point);
+  auto length2 = direction * direction;
+  if (length2 == 0) {
+    return BasicDistance2<T>(0);
+  }
+  if (direction * offset <= 0) {
+    return BasicDistance2<T>(offset * offset);
+  }
+  return BasicDistance2<T>::SquareOver(direction ^ offset, length2);
+}
+
+template <class T>
+BasicIShape<T>* BasicRay<T>::Clone() const {
+  return new BasicRay(*this);
+}
+
+template <class T>
+std::string BasicRay<T>::ToString() {
+  return AppendToString(*this);
+}
+
+template <class T>
+char* BasicRay<T>::AppendTo(char* first, char* last) const {
+  first = AppendText(first, last, "Ray(");
+  first = begin_.AppendTo(first, last);
+  first = AppendText(first, last, ", ");
+  first = direction_.AppendTo(first, last);
+  return AppendText(first, last, ")");
+}
+
+template <class T>
+void BasicRay<T>::ContainsPoints(const T* xs, const T* ys, size_t n,
+                                 uint8_t* out) const {
+  const BasicVector<T> begin = begin_.point;
+
+  bool fits = FitsLanes({begin.x, begin.y, direction_.x, direction_.y}) &&
+              FitsLanes(xs, n) && FitsLanes(ys, n);
+  RunKernel<T>(fits, [&](auto lanes) {
+    using Lanes = typename decltype(lanes)::type;
+    const Lanes direction(direction_);
+    for (size_t i = 0; i < n; ++i) {
+      Lanes offset(BasicVector<T>(xs[i], ys[i]), begin);
+      out[i] = static_cast<uint8_t>(((direction ^ offset) == 0) &
+                                    ((direction * offset) >= 0));
+    }
+  });
+}
+
+// ---------------------------------> Line <---------------------------------
+
+template <class T>
+BasicLine<T>::BasicLine(const BasicPoint<T>& begin, const BasicPoint<T>& end)
+    : first_(begin), second_(end) {
+  using Wide = typename CoordTraits<T>::Wide;
+  using Exact = typename CoordTraits<T>::Exact;
+
+  a_ = static_cast<Wide>(end.point.y) - begin.point.y;  // y2 - y1
+  b_ = static_cast<Wide>(begin.point.x) - end.point.x;  // x1 - x2
+  c_ = static_cast<Exact>(begin.point.x) * -a_ +
+       static_cast<Exact>(begin.point.y) * -b_;
+  // x1 * (y1 - y2) + y1 * (x2 - x1)
+}
+
+template <class T>
+BasicIShape<T>& BasicLine<T>::Move(const BasicVector<T>& shift) {
+  using Exact = typename CoordTraits<T>::Exact;
+
+  c_ -= (static_cast<Exact>(a_) * shift.x + static_cast<Exact>(b_) * shift.y);
+  first_.point += shift;
+  second_.point += shift;
+  return *this;
+}
+
+template <class T>
+bool BasicLine<T>::ContainsPoint(const BasicPoint<T>& other) const {
+  return Orientation(first_.point, second_.point, other.point) == 0;
+}
+
+template <class T>
+bool BasicLine<T>::CrossesSegment(const BasicSegment<T>& other) const {
+  auto borders = other.GetBorders();
+
+  return Orientation(first_.point, second_.point, borders.first.point) *
+             Orientation(first_.point, second_.point, borders.second.point) <=
+         0;
+}
+
+// (a x + b y + c)^2 / (a^2 + b^2); a line through two equal points contains
+// every point, as in ContainsPoint.
+template <class T>
+BasicDistance2<T> BasicLine<T>::SquaredDistance(
+    const BasicPoint<T>& other) const {
+  using Exact = typename CoordTraits<T>::Exact;
+
+  Exact length2 = static_cast<Exact>(a_) * a_ + static_cast<Exact>(b_) * b_;
+  if (length2 == 0) {
+    return BasicDistance2<T>(0);
+  }
+  Exact value = static_cast<Exact>(a_) * other.point.x +
+                static_cast<Exact>(b_) * other.point.y + c_;
+  return BasicDistance2<T>::SquareOver(value, length2);
+}
+
+template <class T>
+BasicIShape<T>* BasicLine<T>::Clone() const {
+  return new BasicLine(*this);
+}
+
+template <class T>
+std::string BasicLine<T>::ToString() {
+  return AppendToString(*this);
+}
+
+template <class T>
+char* BasicLine<T>::AppendTo(char* first, char* last) const {
+  first = AppendText(first, last, "Line(");
+  first = AppendNumber(first, last, a_);
+  first = AppendText(first, last, ", ");
+  first = AppendNumber(first, last, b_);
+  first = AppendText(first, last, ", ");
+  first = AppendNumber(first, last, c_);
+  return AppendText(first, last, ")");
+}
+
+template <class T>
+void BasicLine<T>::ContainsPoints(const T* xs, const T* ys, size_t n,
+                                  uint8_t* out) const {
+  const BasicVector<T> first = first_.point;
+  const BasicVector<T> second = second_.point;
+
+  bool fits = FitsLanes({first.x, first.y, second.x, second.y}) &&
+              FitsLanes(xs, n) && FitsLanes(ys, n);
+  RunKernel<T>(fits, [&](auto lanes) {
+    using Lanes = typename decltype(lanes)::type;
+    const Lanes direction(second, first);
+    for (size_t i = 0; i < n; ++i) {
+      auto cross = direction ^ Lanes(BasicVector<T>(xs[i], ys[i]), first);
+      out[i] = static_cast<uint8_t>(cross == 0);
+    }
+  });
+}
+
+// ---------------------------------> Circle <---------------------------------
+
+template <class T>
+BasicCircle<T>::BasicCircle(const BasicPoint<T>& k_center, T radius)
+    : center_(k_center), radius_(radius) {}
+
+template <class T>
+BasicIShape<T>& BasicCircle<T>::Move(const BasicVector<T>& shift) {
+  center_.point += shift;
+  return *this;
+}
+
+template <class T>
+bool BasicCircle<T>::ContainsPoint(const BasicPoint<T>& other) const {
+  Delta<T> offset(other.point, center_.point);
+  Delta<T> radius(BasicVector<T>(radius_, 0));
+  return offset * offset <= radius * radius;
+}
+
+// The squared distance from the center to a point of the segment is convex
+// along the segment, so the segment meets the circle iff the nearest point
+// is not outside it and the farthest end is not inside it. The nearest
+// point's squared distance is (d ^ w)^2 / (d * d) when it is interior; for
+// integral coordinates that comparison is done on exact 256-bit products
+// instead of a square root.
+template <class T>
+bool BasicCircle<T>::CrossesSegment(const BasicSegment<T>& other) const {
+  auto borders = other.GetBorders();
+  Delta<T> direction(borders.second.point, borders.first.point);
+  Delta<T> to_first(center_.point, borders.first.point);
+  Delta<T> to_second(center_.point, borders.second.point);
+  Delta<T> radius(BasicVector<T>(radius_, 0));
+
+  auto radius2 = radius * radius;
+  auto first_distance2 = to_first * to_first;
+  auto second_distance2 = to_second * to_second;
+  if (std::max(first_distance2, second_distance2) < radius2) {
+    return false;
+  }
+
+  auto projection = direction * to_first;
+  auto length2 = direction * direction;
+  if (projection <= 0) {
+    return first_distance2 <= radius2;
+  }
+  if (projection >= length2) {
+    return second_distance2 <= radius2;
+  }
+
+  auto cross = direction ^ to_first;
+  return CompareProducts(cross, cross, radius2, length2) <= 0;
+}
+
+// The distance to the disk, sqrt(d2) - r outside of it, is irrational in
+// general. For integral coordinates its square d2 + r2 - 2r sqrt(d2) is
+// rounded up, with 2r sqrt(d2) = sqrt(4 r2 d2) rounded down exactly, so it
+// stays zero only inside.
+template <class T>
+BasicDistance2<T> BasicCircle<T>::SquaredDistance(
+    const BasicPoint<T>& other) const {
+  Delta<T> offset(other.point, center_.point);
+  Delta<T> radius(BasicVector<T>(radius_, 0));
+  auto distance2 = offset * offset;
+  auto radius2 = radius * radius;
+  if (distance2 <= radius2) {
+    return BasicDistance2<T>(0);
+  }
+
+  if constexpr (std::is_floating_point_v<T>) {
+    auto gap = std::sqrt(distance2) - std::abs(radius_);
+    return BasicDistance2<T>(gap * gap);
+  } else {
+    return BasicDistance2<T>(distance2 + radius2 -
+                             FloorSqrtProduct(4 * radius2, distance2));
+  }
+}
+
+template <class T>
+BasicIShape<T>* BasicCircle<T>::Clone() const {
+  return new BasicCircle(*this);
+}
+
+template <class T>
+std::string BasicCircle<T>::ToString() {
+  return AppendToString(*this);
+}
+
+template <class T>
+char* BasicCircle<T>::AppendTo(char* first, char* last) const {
+  first = AppendText(first, last, "Circle(");
+  first = center_.AppendTo(first, last);
+  first = AppendText(first, last, ", ");
+  first = AppendNumber(first, last, radius_);
+  return AppendText(first, last, ")");
+}
+
+template <class T>
+void BasicCircle<T>::ContainsPoints(const T* xs, const T* ys, size_t n,
+                                    uint8_t* out) const {
+  const BasicVector<T> center = center_.point;
+
+  bool fits = FitsLanes({center.x, center.y, radius_}) && FitsLanes(xs, n) &&
+              FitsLanes(ys, n);
+  RunKernel<T>(fits, [&](auto lanes) {
+    using Lanes = typename decltype(lanes)::type;
+    const Lanes radius(BasicVector<T>(radius_, 0));
+    const auto radius2 = radius * radius;
+    for (size_t i = 0; i < n; ++i) {
+      Lanes offset(BasicVector<T>(xs[i], ys[i]), center);
+      out[i] = static_cast<uint8_t>(offset * offset <= radius2);
+    }
+  });
+}
+
+// ---------------------------------> Box <---------------------------------
+
+template <class T>
+BasicBox<T> BasicBox<T>::Empty() {
+  return BasicBox{std::numeric_limits<T>::max(), std::numeric_limits<T>::max(),
+                  std::numeric_limits<T>::lowest(),
+                  std::numeric_limits<T>::lowest()};
+}
+
+template <class T>
+BasicBox<T> BasicBox<T>::Of(const BasicVector<T>& first,
+                            const BasicVector<T>& second) {
+  return BasicBox{std::min(first.x, second.x), std::min(first.y, second.y),
+                  std::max(first.x, second.x), std::max(first.y, second.y)};
+}
+
+template <class T>
+bool BasicBox<T>::Intersects(const BasicBox& other) const {
+  return min_x <= other.max_x && other.min_x <= max_x && min_y <= other.max_y &&
+         other.min_y <= max_y;
+}
+
+template <class T>
+void BasicBox<T>::Expand(const BasicBox& other) {
+  min_x = std::min(min_x, other.min_x);
+  min_y = std::min(min_y, other.min_y);
+  max_x = std::max(max_x, other.max_x);
+  max_y = std::max(max_y, other.max_y);
+}
+
+// -------------------------------> RasterCache <-------------------------------
+
+inline double RasterCacheStats::HitRate() const {
+  return lookups == 0 ? 0.0 : static_cast<double>(hits) / lookups;
+}
+
+template <class T>
+typename BasicRasterCache<T>::State BasicRasterCache<T>::Lookup(
+    const BasicVector<T>& point) const {
+  State state = Classify(point);
+  lookups_.fetch_add(1, std::memory_order_relaxed);
+  if (state != kBoundary) {
+    hits_.fetch_add(1, std::memory_order_relaxed);
+  }
+  return state;
+}
+
+template <class T>
+RasterCacheStats BasicRasterCache<T>::GetStats() const {
+  RasterCacheStats stats;
+  stats.lookups = lookups_.load(std::memory_order_relaxed);
+  stats.hits = hits_.load(std::memory_order_relaxed);
+  stats.memory_bytes = coarse_.size() * sizeof(uint32_t) + fine_.size();
+  return stats;
+}
+
+template <class T>
+typename BasicRasterCache<T>::State BasicRasterCache<T>::Classify(
+    const BasicVector<T>& point) const {
+  using Wide = typename CoordTraits<T>::Wide;
+
+  if (coarse_.empty() || !box_.Intersects(BasicBox<T>::Of(point, point))) {
+    return kOutside;
+  }
+
+  size_t column = ColumnOf(point.x);
+  size_t row = RowOf(point.y);
+  uint32_t coarse = coarse_[row * columns_ + column];
+  if (coarse < kRefined) {
+    return static_cast<State>(coarse);
+  }
+
+  BasicBox<T> cell = CellBox(column, row);
+  size_t fine_column = std::min<size_t>(
+      kFine - 1,
+      static_cast<size_t>((static_cast<Wide>(point.x) - cell.min_x) /
+                          fine_width_));
+  size_t fine_row = std::min<size_t>(
+      kFine - 1,
+      static_cast<size_t>((static_cast<Wide>(point.y) - cell.min_y) /
+                          fine_height_));
+  return FineState(((coarse - kRefined) * kFine + fine_row) * kFine +
+                   fine_column);
+}
+
+template <class T>
+size_t BasicRasterCache<T>::ColumnOf(T x) const {
+  using Wide = typename CoordTraits<T>::Wide;
+  return std::min<size_t>(
+      columns_ - 1,
+      static_cast<size_t>((static_cast<Wide>(x) - box_.min_x) / cell_width_));
+}
+
+template <class T>
+size_t BasicRasterCache<T>::RowOf(T y) const {
+  using Wide = typename CoordTraits<T>::Wide;
+  return std::min<size_t>(
+      rows_ - 1,
+      static_cast<size_t>((static_cast<Wide>(y) - box_.min_y) / cell_height_));
+}
+
+// Integral cells are [min, min + width - 1], so that neighbouring cells do
+// not share integer points; floating point ones are closed [min, min + width].
+template <class T>
+BasicBox<T> BasicRasterCache<T>::CellBox(size_t column, size_t row) const {
+  using Wide = typename CoordTraits<T>::Wide;
+  constexpr Wide kUnit = std::is_floating_point_v<T> ? 0 : 1;
+
+  Wide min_x = box_.min_x + static_cast<Wide>(column) * cell_width_;
+  Wide min_y = box_.min_y + static_cast<Wide>(row) * cell_height_;
+  return BasicBox<T>{
+      static_cast<T>(min_x), static_cast<T>(min_y),
+      static_cast<T>(std::min<Wide>(min_x + cell_width_ - kUnit, box_.max_x)),
+      static_cast<T>(std::min<Wide>(min_y + cell_height_ - kUnit, box_.max_y))};
+}
+
+template <class T>
+BasicBox<T> BasicRasterCache<T>::FineBox(const BasicBox<T>& cell,
+                                         size_t column, size_t row) const {
+  using Wide = typename CoordTraits<T>::Wide;
+  constexpr Wide kUnit = std::is_floating_point_v<T> ? 0 : 1;
+
+  Wide min_x = cell.min_x + static_cast<Wide>(column) * fine_width_;
+  Wide min_y = cell.min_y + static_cast<Wide>(row) * fine_height_;
+  return BasicBox<T>{
+      static_cast<T>(min_x), static_cast<T>(min_y),
+      static_cast<T>(std::min<Wide>(min_x + fine_width_ - kUnit, cell.max_x)),
+      static_cast<T>(std::min<Wide>(min_y + fine_height_ - kUnit, cell.max_y))};
+}
+
+template <class T>
+size_t BasicRasterCache<T>::FineColumns(const BasicBox<T>& cell) const {
+  using Wide = typename CoordTraits<T>::Wide;
+  constexpr Wide kUnit = std::is_floating_point_v<T> ? 0 : 1;
+
+  if constexpr (std::is_floating_point_v<T>) {
+    return kFine;
+  }
+  Wide width = static_cast<Wide>(cell.max_x) - cell.min_x + kUnit;
+  return std::min<size_t>(kFine,
+                          static_cast<size_t>(DivideUp(width, fine_width_)));
+}
+
+template <class T>
+size_t BasicRasterCache<T>::FineRows(const BasicBox<T>& cell) const {
+  using Wide = typename CoordTraits<T>::Wide;
+  constexpr Wide kUnit = std::is_floating_point_v<T> ? 0 : 1;
+
+  if constexpr (std::is_floating_point_v<T>) {
+    return kFine;
+  }
+  Wide height = static_cast<Wide>(cell.max_y) - cell.min_y + kUnit;
+  return std::min<size_t>(kFine,
+                          static_cast<size_t>(DivideUp(height, fine_height_)));
+}
+
+template <class T>
+typename BasicRasterCache<T>::State BasicRasterCache<T>::FineState(
+    size_t index) const {
+  return static_cast<State>((fine_[index / 4] >> (2 * (index % 4))) & 3);
+}
+
+template <class T>
+void BasicRasterCache<T>::SetFineState(size_t index, State state) {
+  uint8_t& byte = fine_[index / 4];
+  byte = static_cast<uint8_t>((byte & ~(3 << (2 * (index % 4)))) |
+                              (state << (2 * (index % 4))));
+}
+
+// ---------------------------------> Polygon <---------------------------------
+
+template <class T>
+BasicPolygon<T>::BasicPolygon(std::vector<BasicPoint<T>> vertexes)
+    : vertexes_(std::move(vertexes)) {
+  BuildIndex();
+}
+
+template <class T>
+void BasicPolygon<T>::BuildIndex() {
+  size_t size = vertexes_.size();
+  edges_.clear();
+  edges_.reserve(size);
+  for (size_t i = 0; i < size; ++i) {
+    const BasicVector<T>& begin = vertexes_[i].point;
+    const BasicVector<T>& end = vertexes_[(i + 1) % size].point;
+    edges_.push_back(Edge{begin, end, BasicBox<T>::Of(begin, end)});
+  }
+
+  tree_.clear();
+  leaves_ = 0;
+  if (size < kIndexThreshold) {
+    return;
+  }
+
+  size_t leaf_count = (size + kLeafEdges - 1) / kLeafEdges;
+  leaves_ = 1;
+  while (leaves_ < leaf_count) {
+    leaves_ *= 2;
+  }
+
+  tree_.assign(2 * leaves_, BasicBox<T>::Empty());
+  for (size_t i = 0; i < size; ++i) {
+    tree_[leaves_ + i / kLeafEdges].Expand(edges_[i].box);
+  }
+  for (size_t i = leaves_ - 1; i > 0; --i) {
+    tree_[i] = tree_[2 * i];
+    tree_[i].Expand(tree_[2 * i + 1]);
+  }
+}
+
+// Calls visit(i) for every edge i whose bounding box meets the box, until
+// visit returns true. Returns whether it did.
+template <class T>
+template <class Visitor>
+bool BasicPolygon<T>::VisitEdges(const BasicBox<T>& box, Visitor visit) const {
+  if (tree_.empty()) {
+    for (size_t i = 0; i < edges_.size(); ++i) {
+      if (edges_[i].box.Intersects(box) && visit(i)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  size_t stack[2 * std::numeric_limits<size_t>::digits];
+  size_t top = 0;
+  stack[top++] = 1;
+
+  while (top > 0) {
+    size_t node = stack[--top];
+    if (!tree_[node].Intersects(box)) {
+      continue;
+    }
+    if (node < leaves_) {
+      stack[top++] = 2 * node + 1;
+      stack[top++] = 2 * node;
+      continue;
+    }
+
+    size_t first = (node - leaves_) * kLeafEdges;
+    size_t last = std::min(first + kLeafEdges, edges_.size());
+    for (size_t i = first; i < last; ++i) {
+      if (edges_[i].box.Intersects(box) && visit(i)) {
+        return true;
+      }
+    }
+  }
+
+  return false;
+}
+
+template <class T>
+BasicIShape<T>& BasicPolygon<T>::Move(const BasicVector<T>& shift) {
+  offset_x_ += shift.x;
+  offset_y_ += shift.y;
+  return *this;
+}
+
+template <class T>
+void BasicPolygon<T>::Materialize() {
+  if (offset_x_ == 0 && offset_y_ == 0) {
+    return;
+  }
+  for (BasicPoint<T>& vertex : vertexes_) {
+    vertex.point = ToWorld(vertex.point);
+  }
+  offset_x_ = 0;
+  offset_y_ = 0;
+  BuildIndex();
+  if (raster_cache_) {
+    BuildRasterCache(raster_memory_);
+  }
+}
+
+// Fails when the translated point does not fit in T; such a point lies
+// outside the bounding box of vertexes_.
+template <class T>
+bool BasicPolygon<T>::ToLocal(const BasicVector<T>& point,
+                              BasicVector<T>* local) const {
+  using Wide = typename CoordTraits<T>::Wide;
+  Wide x = static_cast<Wide>(point.x) - offset_x_;
+  Wide y = static_cast<Wide>(point.y) - offset_y_;
+  if constexpr (std::is_integral_v<T>) {
+    const Wide kMin = std::numeric_limits<T>::min();
+    const Wide kMax = std::numeric_limits<T>::max();
+    if (x < kMin || x > kMax || y < kMin || y > kMax) {
+      return false;
+    }
+  }
+  *local = BasicVector<T>(static_cast<T>(x), static_cast<T>(y));
+  return true;
+}
+
+// The outer coordinates of a vertex of the polygon, which fit in T.
+template <class T>
+BasicVector<T> BasicPolygon<T>::ToWorld(const BasicVector<T>& local) const {
+  using Wide = typename CoordTraits<T>::Wide;
+  return BasicVector<T>(static_cast<T>(static_cast<Wide>(local.x) + offset_x_),
+                        static_cast<T>(static_cast<Wide>(local.y) + offset_y_));
+}
+
+template <class T>
+bool BasicPolygon<T>::ContainsPoint(const BasicPoint<T>& other) const {
+  BasicVector<T> local;
+  if (!ToLocal(other.point, &local)) {
+    return false;
+  }
+  if (raster_cache_) {
+    auto state = raster_cache_->Lookup(local);
+    if (state != BasicRasterCache<T>::kBoundary) {
+      return state == BasicRasterCache<T>::kInside;
+    }
+  }
+  return ContainsPointExact(local);
+}
+
+// Only edges whose boxes meet the point, and then the horizontal ray to +x,
+// are looked at.
+template <class T>
+bool BasicPolygon<T>::ContainsPointExact(const BasicVector<T>& origin) const {
+  auto on_edge = [&](size_t i) {
+    return OnSegment(edges_[i].begin, edges_[i].end, origin);
+  };
+  if (VisitEdges(BasicBox<T>::Of(origin, origin), on_edge)) {
+    return true;
+  }
+
+  // Same half-open horizontal ray as ContainsPointsExact, so the answer is
+  // deterministic and safe to compute from several threads at once.
+  const BasicBox<T> ray{origin.x, origin.y, std::numeric_limits<T>::max(),
+                        origin.y};
+  bool inside = false;
+  VisitEdges(ray, [&](size_t i) {
+    const BasicVector<T>& a = edges_[i].begin;
+    const BasicVector<T>& b = edges_[i].end;
+    auto cross = Delta<T>(b, a) ^ Delta<T>(origin, a);
+    if ((a.y <= origin.y && b.y > origin.y && cross > 0) ||
+        (b.y <= origin.y && a.y > origin.y && cross < 0)) {
+      inside = !inside;
+    }
+    return false;
+  });
+
+  return inside;
+}
+
+// The closing edge is not part of the check. A segment reaching out of the
+// local range is checked edge by edge in the outer coordinates instead.
+template <class T>
+bool BasicPolygon<T>::CrossesSegment(const BasicSegment<T>& other) const {
+  auto borders = other.GetBorders();
+  BasicVector<T> begin;
+  BasicVector<T> end;
+  if (!ToLocal(borders.first.point, &begin) ||
+      !ToLocal(borders.second.point, &end)) {
+    for (size_t i = 0; i + 1 < edges_.size(); ++i) {
+      if (SegmentsCross(ToWorld(edges_[i].begin), ToWorld(edges_[i].end),
+                        borders.first.point, borders.second.point)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  return VisitEdges(BasicBox<T>::Of(begin, end), [&](size_t i) {
+    return i + 1 < edges_.size() &&
+           SegmentsCross(edges_[i].begin, edges_[i].end, begin, end);
+  });
+}
+
+// Zero inside, the distance to the nearest edge, the closing one included,
+// outside. As in CrossesSegment, a point out of the local range is measured
+// edge by edge in the outer coordinates.
+template <class T>
+BasicDistance2<T> BasicPolygon<T>::SquaredDistance(
+    const BasicPoint<T>& other) const {
+  if (ContainsPoint(other)) {
+    return BasicDistance2<T>(0);
+  }
+
+  BasicVector<T> local;
+  if (ToLocal(other.point, &local)) {
+    return EdgesDistance2(local);
+  }
+  BasicDistance2<T> best;
+  for (size_t i = 0; i < edges_.size(); ++i) {
+    auto distance = SegmentDistance2(ToWorld(edges_[i].begin),
+                                     ToWorld(edges_[i].end), other.point);
+    if (i == 0 || distance < best) {
+      best = distance;
+    }
+  }
+  return best;
+}
+
+// Branch and bound over the edge index: subtrees farther than the nearest
+// edge found so far are skipped.
+template <class T>
+BasicDistance2<T> BasicPolygon<T>::EdgesDistance2(
+    const BasicVector<T>& origin) const {
+  BasicDistance2<T> best;
+  bool found = false;
+  auto visit = [&](size_t i) {
+    if (found &&
+        BasicDistance2<T>(BoxDistance2(edges_[i].box, origin)) >= best) {
+      return;
+    }
+    auto distance = SegmentDistance2(edges_[i].begin, edges_[i].end, origin);
+    if (!found || distance < best) {
+      best = distance;
+      found = true;
+    }
+  };
+
+  if (tree_.empty()) {
+    for (size_t i = 0; i < edges_.size(); ++i) {
+      visit(i);
+    }
+    return best;
+  }
+
+  VisitNearestLeaves(
+      tree_, leaves_, origin,
+      [&](const BasicDistance2<T>& distance) {
+        return !found || distance < best;
+      },
+      [&](size_t leaf) {
+        size_t first = leaf * kLeafEdges;
+        size_t last = std::min(first + kLeafEdges, edges_.size());
+        for (size_t i = first; i < last; ++i) {
+          visit(i);
+        }
+      });
+  return best;
+}
+
+template <class T>
+BasicIShape<T>* BasicPolygon<T>::Clone() const {
+  return new BasicPolygon(*this);
+}
+
+template <class T>
+std::string BasicPolygon<T>::ToString() {
+  return AppendToString(*this);
+}
+
+template <class T>
+char* BasicPolygon<T>::AppendTo(char* first, char* last) const {
+  first = AppendText(first, last, "Polygon(");
+  for (size_t i = 0; i < vertexes_.size() && first != nullptr; ++i) {
+    if (i > 0) {
+      first = AppendText(first, last, ", ");
+    }
+    first = BasicPoint<T>(ToWorld(vertexes_[i].point)).AppendTo(first, last);
+  }
+  return AppendText(first, last, ")");
+}
+
+template <class T>
+void BasicPolygon<T>::ContainsPoints(const T* xs, const T* ys, size_t n,
+                                     uint8_t* out) const {
+  if (offset_x_ == 0 && offset_y_ == 0) {
+    ContainsLocalPoints(xs, ys, n, out);
+    return;
+  }
+
+  std::vector<T> local_xs(n);
+  std::vector<T> local_ys(n);
+  std::vector<uint8_t> in_range(n);
+  for (size_t i = 0; i < n; ++i) {
+    BasicVector<T> local(0, 0);
+    in_range[i] = ToLocal(BasicVector<T>(xs[i], ys[i]), &local);
+    local_xs[i] = local.x;
+    local_ys[i] = local.y;
+  }
+  ContainsLocalPoints(local_xs.data(), local_ys.data(), n, out);
+  for (size_t i = 0; i < n; ++i) {
+    out[i] &= in_range[i];
+  }
+}
+
+// Points the raster cache resolves are answered from it; the rest go
+// through the exact kernel together.
+template <class T>
+void BasicPolygon<T>::ContainsLocalPoints(const T* xs, const T* ys, size_t n,
+                                          uint8_t* out) const {
+  if (!raster_cache_) {
+    ContainsPointsExact(xs, ys, n, out);
+    return;
+  }
+
+  std::vector<size_t> missed;
+  std::vector<T> missed_xs;
+  std::vector<T> missed_ys;
+  for (size_t i = 0; i < n; ++i) {
+    auto state = raster_cache_->Classify(BasicVector<T>(xs[i], ys[i]));
+    if (state == BasicRasterCache<T>::kBoundary) {
+      missed.push_back(i);
+      missed_xs.push_back(xs[i]);
+      missed_ys.push_back(ys[i]);
+    }
+    out[i] = static_cast<uint8_t>(state == BasicRasterCache<T>::kInside);
+  }
+  raster_cache_->lookups_.fetch_add(n, std::memory_order_relaxed);
+  raster_cache_->hits_.fetch_add(n - missed.size(), std::memory_order_relaxed);
+
+  std::vector<uint8_t> missed_out(missed.size());
+  ContainsPointsExact(missed_xs.data(), missed_ys.data(), missed.size(),
+                      missed_out.data());
+  for (size_t i = 0; i < missed.size(); ++i) {
+    out[missed[i]] = missed_out[i];
+  }
+}
+
+// Crossing-number test against a horizontal ray to +x with the half-open
+// rule for vertexes, so the result does not depend on a random direction.
+// Bit 0 of out[i] accumulates the parity, bit 1 marks the boundary. Points
+// are processed in blocks so that the block stays in cache for every edge.
+// Indexed polygons answer each point through the index instead.
+template <class T>
+void BasicPolygon<T>::ContainsPointsExact(const T* xs, const T* ys, size_t n,
+                                          uint8_t* out) const {
+  const size_t kBlock = 256;
+  if (!tree_.empty()) {
+    for (size_t i = 0; i < n; ++i) {
+      out[i] = ContainsPointExact(BasicVector<T>(xs[i], ys[i]));
+    }
+    return;
+  }
+
+  for (size_t first = 0; first < n; first += kBlock) {
+    size_t last = std::min(n, first + kBlock);
+    std::fill(out + first, out + last, 0);
+    bool block_fits = FitsLanes(xs + first, last - first) &&
+                      FitsLanes(ys + first, last - first);
+
+    for (const Edge& current : edges_) {
+      const BasicVector<T> a = current.begin;
+      const BasicVector<T> b = current.end;
+      const T min_x = current.box.min_x;
+      const T max_x = current.box.max_x;
+      const T min_y = current.box.min_y;
+      const T max_y = current.box.max_y;
+
+      bool fits = block_fits && FitsLanes({min_x, min_y, max_x, max_y});
+      RunKernel<T>(fits, [&](auto lanes) {
+        using Lanes = typename decltype(lanes)::type;
+        const Lanes edge(b, a);
+        for (size_t i = first; i < last; ++i) {
+          auto cross = edge ^ Lanes(BasicVector<T>(xs[i], ys[i]), a);
+          bool upward = (a.y <= ys[i]) & (b.y > ys[i]);
+          bool downward = (b.y <= ys[i]) & (a.y > ys[i]);
+          bool crosses = (upward & (cross > 0)) | (downward & (cross < 0));
+          bool on_edge = (cross == 0) & (xs[i] >= min_x) & (xs[i] <= max_x) &
+                         (ys[i] >= min_y) & (ys[i] <= max_y);
+          out[i] ^= static_cast<uint8_t>(crosses);
+          out[i] |= static_cast<uint8_t>(on_edge << 1);
+        }
+      });
+    }
+
+    for (size_t i = first; i < last; ++i) {
+      out[i] = static_cast<uint8_t>(out[i] != 0);
+    }
+  }
+}
+
+template <class T>
+void BasicPolygon<T>::EnableRasterCache(size_t memory_bytes) {
+  raster_memory_ = memory_bytes;
+  BuildRasterCache(memory_bytes);
+}
+
+template <class T>
+void BasicPolygon<T>::DisableRasterCache() {
+  raster_cache_.reset();
+  raster_memory_ = 0;
+}
+
+template <class T>
+RasterCacheStats BasicPolygon<T>::GetRasterCacheStats() const {
+  return raster_cache_ ? raster_cache_->GetStats() : RasterCacheStats();
+}
+
+// Half of the memory goes to the coarse grid, the rest to refined blocks for
+// boundary cells, taken row by row while the memory lasts. A cell is on the
+// boundary iff an edge meets it. The other cells are flood filled: cells
+// next to each other that no edge meets lie on the same side, so a region
+// is classified by one exact test, or by a neighbouring coarse cell.
+// Cells are tested against the edges grown to reach the next cell, to
+// [min, max + 1] for integral ones, so no edge passes between neighbours.
+// Floating point cells are grown by a margin that covers the rounding of
+// the cell bounds, of Lookup and of the orientation tests instead, so a
+// cell taken as inside or outside is so even near its corners.
+template <class T>
+void BasicPolygon<T>::BuildRasterCache(size_t memory_bytes) {
+  using Wide = typename CoordTraits<T>::Wide;
+  using Cache = BasicRasterCache<T>;
+  constexpr Wide kUnit = std::is_floating_point_v<T> ? 0 : 1;
+  // State of the cells not classified yet. Coarse cells are refined only
+  // once none of them is left, so it does not clash with kRefined.
+  constexpr uint32_t kUnknown = 3;
+  const size_t kFine = Cache::kFine;
+  const size_t kBlockBytes = kFine * kFine / 4;
+
+  auto cache = std::make_shared<Cache>();
+  cache->box_ = BasicBox<T>::Empty();
+  for (const Edge& edge : edges_) {
+    cache->box_.Expand(edge.box);
+  }
+  if (edges_.empty()) {
+    raster_cache_ = cache;
+    return;
+  }
+
+  const BasicBox<T>& box = cache->box_;
+  Wide reach = kUnit;
+  if constexpr (std::is_floating_point_v<T>) {
+    reach = 0x1p-36 * std::max({std::abs(box.min_x), std::abs(box.min_y),
+                                std::abs(box.max_x), std::abs(box.max_y)});
+  }
+  auto grown = [&](const BasicBox<T>& cell) {
+    if constexpr (std::is_floating_point_v<T>) {
+      return BasicBox<T>{cell.min_x - reach, cell.min_y - reach,
+                         cell.max_x + reach, cell.max_y + reach};
+    } else {
+      return BasicBox<T>{cell.min_x, cell.min_y,
+                         cell.max_x + (cell.max_x < box.max_x),
+                         cell.max_y + (cell.max_y < box.max_y)};
+    }
+  };
+  // A coordinate moved by reach down or up, not past bound.
+  auto down = [&](T value, T bound) {
+    return static_cast<T>(
+        std::max<Wide>(bound, static_cast<Wide>(value) - reach));
+  };
+  auto up = [&](T value, T bound) {
+    return static_cast<T>(
+        std::min<Wide>(bound, static_cast<Wide>(value) + reach));
+  };
+
+  size_t coarse_cells = memory_bytes / 2 / sizeof(uint32_t);
+  size_t side = std::max<size_t>(
+      1, static_cast<size_t>(std::sqrt(static_cast<double>(coarse_cells))));
+  Wide width = static_cast<Wide>(box.max_x) - box.min_x + kUnit;
+  Wide height = static_cast<Wide>(box.max_y) - box.min_y + kUnit;
+  cache->cell_width_ = DivideUp(width, static_cast<Wide>(side));
+  cache->cell_height_ = DivideUp(height, static_cast<Wide>(side));
+  if (!(cache->cell_width_ > 0)) {
+    cache->cell_width_ = 1;
+  }
+  if (!(cache->cell_height_ > 0)) {
+    cache->cell_height_ = 1;
+  }
+  cache->fine_width_ = DivideUp(cache->cell_width_, static_cast<Wide>(kFine));
+  cache->fine_height_ = DivideUp(cache->cell_height_, static_cast<Wide>(kFine));
+  if constexpr (std::is_floating_point_v<T>) {
+    cache->columns_ = side;
+    cache->rows_ = side;
+  } else {
+    cache->columns_ =
+        static_cast<size_t>(DivideUp(width, cache->cell_width_));
+    cache->rows_ = static_cast<size_t>(DivideUp(height, cache->cell_height_));
+  }
+
+  size_t columns = cache->columns_;
+  size_t rows = cache->rows_;
+  std::vector<uint32_t>& coarse = cache->coarse_;
+  coarse.assign(columns * rows, kUnknown);
+
+  // Calls visit(column, row) for the coarse cells in rows up to last_row
+  // that the edge may meet.
+  auto for_each_cell = [&](const Edge& edge, size_t last_row, auto visit) {
+    for (size_t row = cache->RowOf(down(edge.box.min_y, box.min_y));
+         row <= std::min(last_row, cache->RowOf(up(edge.box.max_y, box.max_y)));
+         ++row) {
+      BasicBox<T> row_box = grown(cache->CellBox(0, row));
+      auto span =
+          SegmentSpan(edge.begin, edge.end, row_box.min_y, row_box.max_y);
+      for (size_t column = cache->ColumnOf(down(span.first, box.min_x));
+           column <= cache->ColumnOf(up(span.second, box.max_x)); ++column) {
+        visit(column, row);
+      }
+    }
+  };
+
+  for (const Edge& edge : edges_) {
+    for_each_cell(edge, rows - 1, [&](size_t column, size_t row) {
+      uint32_t& cell = coarse[row * columns + column];
+      if (cell != Cache::kBoundary &&
+          SegmentMeetsBox(edge.begin, edge.end,
+                          grown(cache->CellBox(column, row)))) {
+        cell = Cache::kBoundary;
+      }
+    });
+  }
+
+  std::vector<size_t> region;
+  for (size_t start = 0; start < coarse.size(); ++start) {
+    if (coarse[start] != kUnknown) {
+      continue;
+    }
+
+    BasicBox<T> start_box = cache->CellBox(start % columns, start / columns);
+    uint32_t state =
+        ContainsPointExact(BasicVector<T>(start_box.min_x, start_box.min_y))
+            ? Cache::kInside
+            : Cache::kOutside;
+    coarse[start] = state;
+    region.assign(1, start);
+    while (!region.empty()) {
+      size_t i = region.back();
+      region.pop_back();
+      auto visit = [&](size_t j) {
+        if (coarse[j] == kUnknown) {
+          coarse[j] = state;
+          region.push_back(j);
+        }
+      };
+      if (i % columns > 0) {
+        visit(i - 1);
+      }
+      if (i % columns + 1 < columns) {
+        visit(i + 1);
+      }
+      if (i >= columns) {
+        visit(i - columns);
+      }
+      if (i + columns < coarse.size()) {
+        visit(i + columns);
+      }
+    }
+  }
+
+  size_t coarse_bytes = coarse.size() * sizeof(uint32_t);
+  size_t blocks_left =
+      (memory_bytes - std::min(memory_bytes, coarse_bytes)) / kBlockBytes;
+  // The coarse cell of each block.
+  std::vector<size_t> block_cells;
+  for (size_t i = 0; i < coarse.size() && block_cells.size() < blocks_left;
+       ++i) {
+    if (coarse[i] == Cache::kBoundary) {
+      coarse[i] = Cache::kRefined + static_cast<uint32_t>(block_cells.size());
+      block_cells.push_back(i);
+    }
+  }
+  // Fine cells out of their coarse cell, past the end of the bounding box,
+  // are never looked up and stay outside.
+  cache->fine_.assign(block_cells.size() * kBlockBytes, 0);
+
+  // Only the last column and row of coarse cells may have fewer fine ones.
+  std::vector<size_t> fine_columns(columns);
+  for (size_t column = 0; column < columns; ++column) {
+    fine_columns[column] = cache->FineColumns(cache->CellBox(column, 0));
+  }
+  std::vector<size_t> fine_rows(rows);
+  for (size_t row = 0; row < rows; ++row) {
+    fine_rows[row] = cache->FineRows(cache->CellBox(0, row));
+  }
+  // Index of the fine cell at the given offset within a coarse cell.
+  auto fine_index = [&](Wide offset, Wide size) {
+    return std::min<size_t>(kFine - 1, static_cast<size_t>(offset / size));
+  };
+
+  // Fine cells not marked yet in each block and in each of its rows; the
+  // edges skip blocks and rows with none left.
+  std::vector<size_t> unmarked(block_cells.size());
+  std::vector<uint8_t> unmarked_in_row(block_cells.size() * kFine);
+  for (size_t block = 0; block < block_cells.size(); ++block) {
+    size_t column = block_cells[block] % columns;
+    size_t row = block_cells[block] / columns;
+    unmarked[block] = fine_rows[row] * fine_columns[column];
+    for (size_t fine_row = 0; fine_row < fine_rows[row]; ++fine_row) {
+      unmarked_in_row[block * kFine + fine_row] =
+          static_cast<uint8_t>(fine_columns[column]);
+      for (size_t fine_column = 0; fine_column < fine_columns[column];
+           ++fine_column) {
+        cache->SetFineState((block * kFine + fine_row) * kFine + fine_column,
+                            static_cast<typename Cache::State>(kUnknown));
+      }
+    }
+  }
+
+  // Offsets within a coarse cell of the first and the last fine cells that
+  // may meet something from value to value.
+  auto first_offset = [&](T value, T min) {
+    return std::max<Wide>(0, static_cast<Wide>(value) - reach - min);
+  };
+  auto last_offset = [&](T value, T min) {
+    return std::max<Wide>(0, static_cast<Wide>(value) + reach - min);
+  };
+
+  // Fine boundary cells are marked edge by edge too, in the refined cells
+  // the edge meets; the refined cells are all in the first rows.
+  size_t refined_rows =
+      block_cells.empty() ? 0 : block_cells.back() / columns + 1;
+  for (const Edge& edge : edges_) {
+    if (refined_rows == 0) {
+      break;
+    }
+    for_each_cell(edge, refined_rows - 1, [&](size_t column, size_t row) {
+      uint32_t cell = coarse[row * columns + column];
+      if (cell < Cache::kRefined || unmarked[cell - Cache::kRefined] == 0) {
+        return;
+      }
+      BasicBox<T> cell_box = cache->CellBox(column, row);
+      BasicBox<T> grown_box = grown(cell_box);
+      if (!SegmentMeetsBox(edge.begin, edge.end, grown_box)) {
+        return;
+      }
+
+      size_t block = cell - Cache::kRefined;
+      for (size_t fine_row = fine_index(
+               first_offset(edge.box.min_y, cell_box.min_y),
+               cache->fine_height_);
+           fine_row < fine_rows[row] &&
+           fine_row <= fine_index(last_offset(edge.box.max_y, cell_box.min_y),
+                                  cache->fine_height_);
+           ++fine_row) {
+        if (unmarked_in_row[block * kFine + fine_row] == 0) {
+          continue;
+        }
+        BasicBox<T> row_box = grown(cache->FineBox(cell_box, 0, fine_row));
+        auto span =
+            SegmentSpan(edge.begin, edge.end, row_box.min_y, row_box.max_y);
+        if (static_cast<Wide>(span.second) + reach < grown_box.min_x ||
+            static_cast<Wide>(span.first) - reach > grown_box.max_x) {
+          continue;
+        }
+
+        for (size_t fine_column = fine_index(
+                 first_offset(span.first, cell_box.min_x), cache->fine_width_);
+             fine_column < fine_columns[column] &&
+             fine_column <= fine_index(last_offset(span.second, cell_box.min_x),
+                                       cache->fine_width_);
+             ++fine_column) {
+          size_t index = (block * kFine + fine_row) * kFine + fine_column;
+          if (cache->FineState(index) != Cache::kBoundary &&
+              SegmentMeetsBox(
+                  edge.begin, edge.end,
+                  grown(cache->FineBox(cell_box, fine_column, fine_row)))) {
+            cache->SetFineState(index, Cache::kBoundary);
+            --unmarked[block];
+            --unmarked_in_row[block * kFine + fine_row];
+          }
+        }
+      }
+    });
+  }
+
+  // The fine grid lines up across blocks, so regions of fine cells are
+  // followed from block to block. Cells of the region being searched are
+  // kept as boundary until it gets its state.
+  for (size_t start = 0; start < block_cells.size() * kFine * kFine; ++start) {
+    if (cache->FineState(start) != kUnknown) {
+      continue;
+    }
+
+    uint32_t state = kUnknown;
+    region.assign(1, start);
+    cache->SetFineState(start, Cache::kBoundary);
+    for (size_t next = 0; next < region.size(); ++next) {
+      size_t index = region[next];
+      size_t cell = block_cells[index / (kFine * kFine)];
+      size_t column = cell % columns;
+      size_t row = cell / columns;
+      size_t fine_row = index / kFine % kFine;
+      size_t fine_column = index % kFine;
+      auto visit = [&](size_t to_column, size_t to_row, size_t to_fine_column,
+                       size_t to_fine_row) {
+        uint32_t to = coarse[to_row * columns + to_column];
+        if (to < Cache::kRefined) {
+          if (to != Cache::kBoundary) {
+            state = to;
+          }
+          return;
+        }
+        size_t to_index =
+            ((to - Cache::kRefined) * kFine + to_fine_row) * kFine +
+            to_fine_column;
+        if (cache->FineState(to_index) == kUnknown) {
+          cache->SetFineState(to_index, Cache::kBoundary);
+          region.push_back(to_index);
+        }
+      };
+
+      if (fine_column > 0) {
+        visit(column, row, fine_column - 1, fine_row);
+      } else if (column > 0) {
+        visit(column - 1, row, fine_columns[column - 1] - 1, fine_row);
+      }
+      if (fine_column + 1 < fine_columns[column]) {
+        visit(column, row, fine_column + 1, fine_row);
+      } else if (column + 1 < columns) {
+        visit(column + 1, row, 0, fine_row);
+      }
+      if (fine_row > 0) {
+        visit(column, row, fine_column, fine_row - 1);
+      } else if (row > 0) {
+        visit(column, row - 1, fine_column, fine_rows[row - 1] - 1);
+      }
+      if (fine_row + 1 < fine_rows[row]) {
+        visit(column, row, fine_column, fine_row + 1);
+      } else if (row + 1 < rows) {
+        visit(column, row + 1, fine_column, 0);
+      }
+    }
+
+    if (state == kUnknown) {
+      size_t cell = block_cells[start / (kFine * kFine)];
+      BasicBox<T> fine_box = cache->FineBox(
+          cache->CellBox(cell % columns, cell / columns), start % kFine,
+          start / kFine % kFine);
+      state = ContainsPointExact(BasicVector<T>(fine_box.min_x, fine_box.min_y))
+                  ? Cache::kInside
+                  : Cache::kOutside;
+    }
+    for (size_t index : region) {
+      cache->SetFineState(index, static_cast<typename Cache::State>(state));
+    }
+  }
+
+  raster_cache_ = cache;
+}
+
+// ------------------------------> Intersections <------------------------------
+
+// Rational point (x / d, y / d) with d > 0. Crossings of two integer segments
+// are exact in this form.
+struct SweepPoint {
+  __int128 x;
+  __int128 y;
+  __int128 d;
+};
+
+inline int CompareSweepPoints(const SweepPoint& first,
+                              const SweepPoint& second) {
+  if (first.d == 1 && second.d == 1) {
+    if (first.x != second.x) {
+      return first.x < second.x ? -1 : 1;
+    }
+    return Sign(first.y - second.y);
+  }
+
+  int by_x = CompareProducts(first.x, second.d, second.x, first.d);
+  if (by_x != 0) {
+    return by_x;
+  }
+  return CompareProducts(first.y, second.d, second.y, first.d);
+}
+
+struct SweepPointLess {
+  bool operator()(const SweepPoint& first, const SweepPoint& second) const {
+    return CompareSweepPoints(first, second) < 0;
+  }
+};
+
+// Segment with its endpoints ordered along the sweep: (x1, y1) < (x2, y2).
+struct SweepSegment {
+  long long x1;
+  long long y1;
+  long long x2;
+  long long y2;
+};
+
+// Positive if the point lies above the segment's line, zero if on it.
+inline int SideOfSegment(const SweepSegment& segment, long long x,
+                         long long y) {
+  return Sign(
+      static_cast<__int128>(segment.x2 - segment.x1) * (y - segment.y1) -
+      static_cast<__int128>(segment.y2 - segment.y1) * (x - segment.x1));
+}
+
+inline int SideOfSegment(const SweepSegment& segment,
+                         const SweepPoint& point) {
+  if (point.d == 1) {
+    return SideOfSegment(segment, static_cast<long long>(point.x),
+                         static_cast<long long>(point.y));
+  }
+  return CompareProducts(segment.x2 - segment.x1,
+                         point.y - segment.y1 * point.d,
+                         segment.y2 - segment.y1,
+                         point.x - segment.x1 * point.d);
+}
+
+// Positive if second turns counterclockwise from first, zero if parallel.
+inline __int128 Turn(const SweepSegment& first, const SweepSegment& second) {
+  return static_cast<__int128>(first.x2 - first.x1) * (second.y2 - second.y1) -
+         static_cast<__int128>(first.y2 - first.y1) * (second.x2 - second.x1);
+}
+
+// Order of the segments along the sweep line just after the sweep point.
+// Segments through the sweep point are ordered by direction, a vertical one
+// being the highest; collinear ones by index. Every segment inserted into
+// the status passes through the sweep point, so it is always compared to
+// the rest by the side the sweep point lies on. Probing with the sweep
+// point itself finds the run of segments that contain it.
+class SweepStatusLess {
+ public:
+  using is_transparent = void;
+
+  SweepStatusLess(const std::vector<SweepSegment>* segments,
+                  const SweepPoint* point)
+      : segments_(segments), point_(point) {}
+
+  bool operator()(size_t first, size_t second) const {
+    const SweepSegment& lhs = (*segments_)[first];
+    const SweepSegment& rhs = (*segments_)[second];
+    int first_side = SideOfSegment(lhs, *point_);
+    int second_side = SideOfSegment(rhs, *point_);
+
+    if (first_side == 0 && second_side == 0) {
+      __int128 turn = Turn(lhs, rhs);
+      if (turn != 0) {
+        return turn > 0;
+      }
+      return first < second;
+    }
+    if (first_side == 0) {
+      return second_side < 0;
+    }
+    if (second_side == 0) {
+      return first_side > 0;
+    }
+
+    if (lhs.x1 > rhs.x1 || (lhs.x1 == rhs.x1 && lhs.y1 >= rhs.y1)) {
+      return SideOfSegment(rhs, lhs.x1, lhs.y1) < 0;
+    }
+    return SideOfSegment(lhs, rhs.x1, rhs.y1) > 0;
+  }
+
+  bool operator()(size_t segment, const SweepPoint& point) const {
+    return SideOfSegment((*segments_)[segment], point) > 0;
+  }
+
+  bool operator()(const SweepPoint& point, size_t segment) const {
+    return SideOfSegment((*segments_)[segment], point) < 0;
+  }
+
+ private:
+  const std::vector<SweepSegment>* segments_;
+  const SweepPoint* point_;
+};
+
+// Schedules the crossing of two neighbouring segments if it lies after the
+// sweep point. Parallel segments are skipped: a collinear overlap always
+// starts at an endpoint, which is an event already.
+inline void AddCrossingEvent(
+    const SweepSegment& first, const SweepSegment& second,
+    const SweepPoint& current,
+    std::map<SweepPoint, std::vector<size_t>, SweepPointLess>* events) {
+  __int128 first_dx = first.x2 - first.x1;
+  __int128 first_dy = first.y2 - first.y1;
+  __int128 second_dx = second.x2 - second.x1;
+  __int128 second_dy = second.y2 - second.y1;
+
+  __int128 denominator = first_dx * second_dy - first_dy * second_dx;
+  if (denominator == 0) {
+    return;
+  }
+  if (SideOfSegment(first, second.x1, second.y1) *
+              SideOfSegment(first, second.x2, second.y2) > 0 ||
+      SideOfSegment(second, first.x1, first.y1) *
+              SideOfSegment(second, first.x2, first.y2) > 0) {
+    return;
+  }
+
+  __int128 numerator = (second.x1 - first.x1) * second_dy -
+                       (second.y1 - first.y1) * second_dx;
+  if (denominator < 0) {
+    denominator = -denominator;
+    numerator = -numerator;
+  }
+
+  SweepPoint crossing{first.x1 * denominator + first_dx * numerator,
+                      first.y1 * denominator + first_dy * numerator,
+                      denominator};
+  if (CompareSweepPoints(crossing, current) > 0) {
+    (*events)[crossing];
+  }
+}
+
+inline std::vector<std::pair<size_t, size_t>> FindIntersections(
+    const std::vector<Segment>& segments) {
+  std::vector<SweepSegment> normalized(segments.size());
+  std::map<SweepPoint, std::vector<size_t>, SweepPointLess> events;
+
+  for (size_t i = 0; i < segments.size(); ++i) {
+    auto borders = segments[i].GetBorders();
+    Vector begin = borders.first.point;
+    Vector end = borders.second.point;
+    if (end.x < begin.x || (end.x == begin.x && end.y < begin.y)) {
+      std::swap(begin, end);
+    }
+
+    normalized[i] = SweepSegment{begin.x, begin.y, end.x, end.y};
+    events[SweepPoint{begin.x, begin.y, 1}].push_back(i);
+    events[SweepPoint{end.x, end.y, 1}];
+  }
+
+  SweepPoint current{0, 0, 1};
+  std::set<size_t, SweepStatusLess> status(
+      SweepStatusLess(&normalized, &current));
+  std::vector<std::pair<size_t, size_t>> result;
+  std::vector<size_t> through;
+  std::vector<size_t> runs;
+
+  while (!events.empty()) {
+    auto event = events.begin();
+    current = event->first;
+    std::vector<size_t> starting = std::move(event->second);
+    events.erase(event);
+
+    auto lower = status.lower_bound(current);
+    auto upper = status.upper_bound(current);
+    through.assign(lower, upper);
+
+    // A pair of segments that started before the event meets only here
+    // unless the two are collinear, and then their pair was reported where
+    // the later one started. The status keeps collinear segments next to
+    // each other, so only pairs across runs of parallel ones are new.
+    runs.clear();
+    for (size_t run = 0; run < through.size();) {
+      size_t next = run + 1;
+      while (next < through.size() &&
+             Turn(normalized[through[run]], normalized[through[next]]) == 0) {
+        ++next;
+      }
+      for (size_t i = run; i < next; ++i) {
+        for (size_t j = next; j < through.size(); ++j) {
+          result.emplace_back(std::min(through[i], through[j]),
+                              std::max(through[i], through[j]));
+        }
+      }
+      runs.push_back(run);
+      run = next;
+    }
+    for (size_t i = 0; i < starting.size(); ++i) {
+      for (size_t j = 0; j < through.size() + i; ++j) {
+        size_t other = j < through.size() ? through[j]
+                                          : starting[j - through.size()];
+        result.emplace_back(std::min(starting[i], other),
+                            std::max(starting[i], other));
+      }
+    }
+
+    // Past the event the runs come in reverse order, each keeping its own,
+    // so the segments that go on are put back in place by hint. A single
+    // run, such as overlapping collinear segments, stays where it is.
+    bool single_run = runs.size() == 1;
+    if (!single_run) {
+      status.erase(lower, upper);
+    }
+    bool inserted = false;
+    runs.push_back(through.size());
+    for (size_t run = runs.size() - 1; run > 0; --run) {
+      for (size_t i = runs[run - 1]; i < runs[run]; ++i) {
+        const SweepSegment& segment = normalized[through[i]];
+        bool goes_on = CompareSweepPoints(
+                           SweepPoint{segment.x2, segment.y2, 1}, current) > 0;
+        if (single_run) {
+          auto next = std::next(lower);
+          if (!goes_on) {
+            status.erase(lower);
+          }
+          lower = next;
+        } else if (goes_on) {
+          status.insert(upper, through[i]);
+        }
+        inserted |= goes_on;
+      }
+    }
+    for (size_t index : starting) {
+      const SweepSegment& segment = normalized[index];
+      if (CompareSweepPoints(SweepPoint{segment.x2, segment.y2, 1}, current) >
+          0) {
+        status.insert(index);
+        inserted = true;
+      }
+    }
+
+    lower = status.lower_bound(current);
+    if (!inserted) {
+      if (lower != status.begin() && lower != status.end()) {
+        AddCrossingEvent(normalized[*std::prev(lower)], normalized[*lower],
+                         current, &events);
+      }
+      continue;
+    }
+
+    upper = status.upper_bound(current);
+    if (lower != status.begin()) {
+      AddCrossingEvent(normalized[*std::prev(lower)], normalized[*lower],
+                       current, &events);
+    }
+    if (upper != status.end()) {
+      AddCrossingEvent(normalized[*std::prev(upper)], normalized[*upper],
+                       current, &events);
+    }
+  }
+
+  std::sort(result.begin(), result.end());
+  assert(std::adjacent_find(result.begin(), result.end()) == result.end());
+  return result;
+}
+
+// ----------------------------> Parallel queries <----------------------------
+
+inline WorkStealingPool::WorkStealingPool(size_t threads)
+    : size_(std::max<size_t>(threads, 1)), queues_(new Queue[size_]) {
+  threads_.reserve(size_);
+  for (size_t worker = 0; worker < size_; ++worker) {
+    threads_.emplace_back([this, worker] { Work(worker); });
+  }
+}
+
+inline WorkStealingPool::~WorkStealingPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  wake_.notify_all();
+  for (std::thread& thread : threads_) {
+    thread.join();
+  }
+}
+
+inline size_t WorkStealingPool::Size() const {
+  return size_;
+}
+
+// Every worker starts with a contiguous range of tasks, so neighbouring
+// tasks stay on one thread unless they are stolen.
+inline void WorkStealingPool::Run(size_t count,
+                                  const std::function<void(size_t)>& task) {
+  if (count == 0) {
+    return;
+  }
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  task_ = &task;
+  remaining_.store(count);
+  for (size_t worker = 0; worker < size_; ++worker) {
+    std::lock_guard<std::mutex> queue_lock(queues_[worker].mutex);
+    for (size_t i = count * worker / size_; i < count * (worker + 1) / size_;
+         ++i) {
+      queues_[worker].tasks.push_back(i);
+    }
+  }
+  ++generation_;
+  wake_.notify_all();
+  done_.wait(lock, [this] { return remaining_.load() == 0; });
+  task_ = nullptr;
+}
+
+inline void WorkStealingPool::Work(size_t worker) {
+  size_t seen = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      wake_.wait(lock, [&] { return stop_ || generation_ != seen; });
+      if (stop_) {
+        return;
+      }
+      seen = generation_;
+    }
+
+    size_t task;
+    while (Take(worker, &task)) {
+      (*task_)(task);
+      if (remaining_.fetch_sub(1) == 1) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        done_.notify_one();
+      }
+    }
+  }
+}
+
+inline bool WorkStealingPool::Take(size_t worker, size_t* task) {
+  {
+    Queue& own = queues_[worker];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.tasks.empty()) {
+      *task = own.tasks.back();
+      own.tasks.pop_back();
+      return true;
+    }
+  }
+  for (size_t i = 1; i < size_; ++i) {
+    Queue& victim = queues_[(worker + i) % size_];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.tasks.empty()) {
+      *task = victim.tasks.front();
+      victim.tasks.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+template <class T>
+BasicQueryEngine<T>::BasicQueryEngine(size_t threads) : pool_(threads) {
+}
+
+template <class T>
+size_t BasicQueryEngine<T>::Threads() const {
+  return pool_.Size();
+}
+
+template <class T>
+template <class Fill>
+std::vector<std::pair<size_t, size_t>> BasicQueryEngine<T>::Collect(
+    size_t count, Fill fill) {
+  size_t chunks = (count + kChunk - 1) / kChunk;
+  std::vector<std::vector<std::pair<size_t, size_t>>> buffers(chunks);
+  pool_.Run(chunks, [&](size_t chunk) {
+    size_t first = chunk * kChunk;
+    fill(first, std::min(count, first + kChunk), &buffers[chunk]);
+  });
+
+  size_t total = 0;
+  for (const auto& buffer : buffers) {
+    total += buffer.size();
+  }
+  std::vector<std::pair<size_t, size_t>> result;
+  result.reserve(total);
+  for (const auto& buffer : buffers) {
+    result.insert(result.end(), buffer.begin(), buffer.end());
+  }
+  return result;
+}
+
+// Each chunk goes through the shapes' batch ContainsPoints, one shape at a
+// time, and is then read out point by point to keep the pairs sorted.
+template <class T>
+std::vector<std::pair<size_t, size_t>> BasicQueryEngine<T>::ContainsPoints(
+    const std::vector<BasicPoint<T>>& points,
+    const std::vector<const BasicIShape<T>*>& shapes) {
+  return Collect(points.size(), [&](size_t first, size_t last, auto* hits) {
+    size_t n = last - first;
+    std::vector<T> xs(n);
+    std::vector<T> ys(n);
+    for (size_t i = 0; i < n; ++i) {
+      xs[i] = points[first + i].point.x;
+      ys[i] = points[first + i].point.y;
+    }
+
+    std::vector<uint8_t> inside(n * shapes.size());
+    for (size_t j = 0; j < shapes.size(); ++j) {
+      shapes[j]->ContainsPoints(xs.data(), ys.data(), n, &inside[j * n]);
+    }
+    for (size_t i = 0; i < n; ++i) {
+      for (size_t j = 0; j < shapes.size(); ++j) {
+        if (inside[j * n + i]) {
+          hits->emplace_back(first + i, j);
+        }
+      }
+    }
+  });
+}
+
+template <class T>
+std::vector<std::pair<size_t, size_t>> BasicQueryEngine<T>::CrossesSegments(
+    const std::vector<BasicSegment<T>>& segments,
+    const std::vector<const BasicIShape<T>*>& shapes) {
+  return Collect(segments.size(), [&](size_t first, size_t last, auto* hits) {
+    for (size_t i = first; i < last; ++i) {
+      for (size_t j = 0; j < shapes.size(); ++j) {
+        if (shapes[j]->CrossesSegment(segments[i])) {
+          hits->emplace_back(i, j);
+        }
+      }
+    }
+  });
+}
+
+// ---------------------------------> KD-tree <---------------------------------
+
+template <class T>
+BasicKdTree<T>::BasicKdTree(const std::vector<BasicPoint<T>>& points) {
+  items_.reserve(points.size());
+  for (size_t i = 0; i < points.size(); ++i) {
+    items_.push_back(Item{points[i].point, points[i].point, i});
+  }
+  Build();
+}
+
+template <class T>
+BasicKdTree<T>::BasicKdTree(const std::vector<BasicSegment<T>>& segments) {
+  items_.reserve(segments.size());
+  for (size_t i = 0; i < segments.size(); ++i) {
+    auto borders = segments[i].GetBorders();
+    items_.push_back(Item{borders.first.point, borders.second.point, i});
+  }
+  Build();
+}
+
+template <class T>
+void BasicKdTree<T>::Build() {
+  tree_.clear();
+  leaves_ = 0;
+  if (items_.empty()) {
+    return;
+  }
+
+  size_t leaf_count = (items_.size() + kLeafItems - 1) / kLeafItems;
+  leaves_ = 1;
+  while (leaves_ < leaf_count) {
+    leaves_ *= 2;
+  }
+  Split(0, leaves_);
+
+  tree_.assign(2 * leaves_, BasicBox<T>::Empty());
+  for (size_t i = 0; i < items_.size(); ++i) {
+    tree_[leaves_ + i / kLeafItems].Expand(
+        BasicBox<T>::Of(items_[i].begin, items_[i].end));
+  }
+  for (size_t i = leaves_ - 1; i > 0; --i) {
+    tree_[i] = tree_[2 * i];
+    tree_[i].Expand(tree_[2 * i + 1]);
+  }
+}
+
+// Orders the items of leaves [first_leaf, last_leaf) so that those of the
+// first half have centres no greater than those of the second along the axis
+// the centres spread over more.
+template <class T>
+void BasicKdTree<T>::Split(size_t first_leaf, size_t last_leaf) {
+  using Wide = typename CoordTraits<T>::Wide;
+
+  auto first = items_.begin() +
+               std::min(first_leaf * kLeafItems, items_.size());
+  auto last = items_.begin() +
+              std::min(last_leaf * kLeafItems, items_.size());
+  if (last - first <= static_cast<std::ptrdiff_t>(kLeafItems)) {
+    return;
+  }
+
+  // Doubled centres, which are exact.
+  auto center_x = [](const Item& item) {
+    return static_cast<Wide>(item.begin.x) + item.end.x;
+  };
+  auto center_y = [](const Item& item) {
+    return static_cast<Wide>(item.begin.y) + item.end.y;
+  };
+  auto [min_x, max_x] = std::minmax_element(
+      first, last,
+      [&](const Item& a, const Item& b) { return center_x(a) < center_x(b); });
+  auto [min_y, max_y] = std::minmax_element(
+      first, last,
+      [&](const Item& a, const Item& b) { return center_y(a) < center_y(b); });
+  bool by_x = center_x(*max_x) - center_x(*min_x) >=
+              center_y(*max_y) - center_y(*min_y);
+
+  size_t middle_leaf = first_leaf + (last_leaf - first_leaf) / 2;
+  auto middle = items_.begin() + middle_leaf * kLeafItems;
+  std::nth_element(first, middle, last, [&](const Item& a, const Item& b) {
+    return by_x ? center_x(a) < center_x(b) : center_y(a) < center_y(b);
+  });
+  Split(first_leaf, middle_leaf);
+  Split(middle_leaf, last_leaf);
+}
+
+template <class T>
+template <class Accept, class Visitor>
+void BasicKdTree<T>::Search(const BasicVector<T>& point, Accept accept,
+                            Visitor visit) const {
+  VisitNearestLeaves(tree_, leaves_, point, accept, [&](size_t leaf) {
+    size_t first = leaf * kLeafItems;
+    size_t last = std::min(first + kLeafItems, items_.size());
+    for (size_t i = first; i < last; ++i) {
+      const Item& item = items_[i];
+      if (accept(BasicDistance2<T>(
+              BoxDistance2(BasicBox<T>::Of(item.begin, item.end), point)))) {
+        visit(item);
+      }
+    }
+  });
+}
+
+template <class T>
+size_t BasicKdTree<T>::Size() const {
+  return items_.size();
+}
+
+template <class T>
+size_t BasicKdTree<T>::Nearest(const BasicPoint<T>& point) const {
+  size_t best = 0;
+  BasicDistance2<T> best_distance;
+  bool found = false;
+  Search(
+      point.point,
+      [&](const BasicDistance2<T>& distance) {
+        return !found || distance <= best_distance;
+      },
+      [&](const Item& item) {
+        auto distance = SegmentDistance2(item.begin, item.end, point.point);
+        auto order = distance <=> best_distance;
+        if (!found || order < 0 || (order == 0 && item.index < best)) {
+          best = item.index;
+          best_distance = distance;
+          found = true;
+        }
+      });
+  return best;
+}
+
+// A max-heap of the k best (distance, index) pairs found so far.
+template <class T>
+std::vector<size_t> BasicKdTree<T>::NearestK(const BasicPoint<T>& point,
+                                             size_t k) const {
+  if (k == 0) {
+    return {};
+  }
+  std::vector<std::pair<BasicDistance2<T>, size_t>> heap;
+  heap.reserve(std::min(k, items_.size()));
+
+  Search(
+      point.point,
+      [&](const BasicDistance2<T>& distance) {
+        return heap.size() < k || distance <= heap.front().first;
+      },
+      [&](const Item& item) {
+        std::pair<BasicDistance2<T>, size_t> candidate(
+            SegmentDistance2(item.begin, item.end, point.point), item.index);
+        if (heap.size() < k) {
+          heap.push_back(candidate);
+          std::push_heap(heap.begin(), heap.end());
+        } else if (candidate < heap.front()) {
+          std::pop_heap(heap.begin(), heap.end());
+          heap.back() = candidate;
+          std::push_heap(heap.begin(), heap.end());
+        }
+      });
+
+  std::sort_heap(heap.begin(), heap.end());
+  std::vector<size_t> result;
+  result.reserve(heap.size());
+  for (const auto& entry : heap) {
+    result.push_back(entry.second);
+  }
+  return result;
+}
+
+template <class T>
+std::vector<size_t> BasicKdTree<T>::WithinRadius(const BasicPoint<T>& point,
+                                                 T radius) const {
+  Delta<T> scale(BasicVector<T>(radius, 0));
+  BasicDistance2<T> limit(scale * scale);
+  std::vector<size_t> result;
+  Search(
+      point.point,
+      [&](const BasicDistance2<T>& distance) { return distance <= limit; },
+      [&](const Item& item) {
+        if (SegmentDistance2(item.begin, item.end, point.point) <= limit) {
+          result.push_back(item.index);
+        }
+      });
+  std::sort(result.begin(), result.end());
+  return result;
+}
+
+// ---------------------------------> Parsing <---------------------------------
+
+template <class T>
+const char* Parse(const char* first, const char* last, BasicVector<T>* out) {
+  T x;
+  T y;
+  first = ParseText(first, last, "Vector(");
+  first = ParseNumber(first, last, &x);
+  first = ParseText(first, last, ",");
+  first = ParseNumber(first, last, &y);
+  first = ParseText(first, last, ")");
+  if (first != nullptr) {
+    *out = BasicVector<T>(x, y);
+  }
+  return first;
+}
+
+template <class T>
+const char* Parse(const char* first, const char* last, BasicPoint<T>* out) {
+  T x;
+  T y;
+  first = ParseText(first, last, "Point(");
+  first = ParseNumber(first, last, &x);
+  first = ParseText(first, last, ",");
+  first = ParseNumber(first, last, &y);
+  first = ParseText(first, last, ")");
+  if (first != nullptr) {
+    out->point = BasicVector<T>(x, y);
+  }
+  return first;
+}
+
+template <class T>
+const char* Parse(const char* first, const char* last, BasicSegment<T>* out) {
+  BasicPoint<T> begin;
+  BasicPoint<T> end;
+  first = ParseText(first, last, "Segment(");
+  first = Parse(first, last, &begin);
+  first = ParseText(first, last, ",");
+  first = Parse(first, last, &end);
+  first = ParseText(first, last, ")");
+  if (first != nullptr) {
+    *out = BasicSegment<T>(begin, end);
+  }
+  return first;
+}
+
+template <class T>
+const char* Parse(const char* first, const char* last, BasicRay<T>* out) {
+  BasicPoint<T> begin;
+  BasicVector<T> direction(0, 0);
+  first = ParseText(first, last, "Ray(");
+  first = Parse(first, last, &begin);
+  first = ParseText(first, last, ",");
+  first = Parse(first, last, &direction);
+  first = ParseText(first, last, ")");
+  if (first != nullptr) {
+    *out = BasicRay<T>(begin, direction);
+  }
+  return first;
+}
+
+template <class T>
+const char* Parse(const char* first, const char* last, BasicCircle<T>* out) {
+  BasicPoint<T> center;
+  T radius;
+  first = ParseText(first, last, "Circle(");
+  first = Parse(first, last, &center);
+  first = ParseText(first, last, ",");
+  first = ParseNumber(first, last, &radius);
+  first = ParseText(first, last, ")");
+  if (first != nullptr) {
+    *out = BasicCircle<T>(center, radius);
+  }
+  return first;
+}
+
+template <class T>
+const char* Parse(const char* first, const char* last, BasicPolygon<T>* out) {
+  std::vector<BasicPoint<T>> vertexes;
+  first = ParseText(first, last, "Polygon(");
+  const char* end = ParseText(first, last, ")");
+  while (first != nullptr && end == nullptr) {
+    vertexes.emplace_back();
+    first = Parse(first, last, &vertexes.back());
+    end = ParseText(first, last, ")");
+    if (end == nullptr) {
+      first = ParseText(first, last, ",");
+    }
+  }
+  if (end != nullptr) {
+    *out = BasicPolygon<T>(std::move(vertexes));
+  }
+  return end;
+}
+
+template <class T>
+const char* Parse(const char* first, const char* last,
+                  std::unique_ptr<BasicIShape<T>>* out) {
+  auto parse = [&](auto shape) {
+    const char* end = Parse(first, last, &shape);
+    if (end != nullptr) {
+      *out = std::make_unique<decltype(shape)>(std::move(shape));
+    }
+    return end;
+  };
+
+  if (ParseText(first, last, "Point(") != nullptr) {
+    return parse(BasicPoint<T>());
+  }
+  if (ParseText(first, last, "Segment(") != nullptr) {
+    return parse(BasicSegment<T>());
+  }
+  if (ParseText(first, last, "Ray(") != nullptr) {
+    return parse(BasicRay<T>());
+  }
+  if (ParseText(first, last, "Circle(") != nullptr) {
+    return parse(BasicCircle<T>());
+  }
+  if (ParseText(first, last, "Polygon(") != nullptr) {
+    return parse(BasicPolygon<T>());
+  }
+  return nullptr;
 }
 
 }  // namespace Geometry
@@ -0,0 +1,216 @@
+#pragma once
+
+#include <cstdlib>
+#include <vector>
+
+// Brute-force versions of the geometry predicates and distances, written
+// independently of geometry.hpp for differential tests and benchmarks.
+// Products are taken in __int128, so the predicates are exact for any int
+// coordinates, except for CircleMeetsSegment, which needs coordinates and
+// radius below 2^30.
+namespace Reference {
+
+struct Vec {
+  long long x;
+  long long y;
+};
+
+inline Vec Sub(Vec first, Vec second) {
+  return {first.x - second.x, first.y - second.y};
+}
+
+inline __int128 Cross(Vec first, Vec second) {
+  return static_cast<__int128>(first.x) * second.y -
+         static_cast<__int128>(first.y) * second.x;
+}
+
+inline __int128 Dot(Vec first, Vec second) {
+  return static_cast<__int128>(first.x) * second.x +
+         static_cast<__int128>(first.y) * second.y;
+}
+
+inline bool Equal(Vec first, Vec second) {
+  return first.x == second.x && first.y == second.y;
+}
+
+// p lies on [a, b] iff it is on the line and a, b are not on one side of it.
+inline bool OnSegment(Vec a, Vec b, Vec p) {
+  return Cross(Sub(b, a), Sub(p, a)) == 0 && Dot(Sub(a, p), Sub(b, p)) <= 0;
+}
+
+// Solves a + t (b - a) = c + u (d - c) and checks t, u in [0, 1].
+inline bool SegmentsMeet(Vec a, Vec b, Vec c, Vec d) {
+  Vec r = Sub(b, a);
+  Vec s = Sub(d, c);
+  __int128 denominator = Cross(r, s);
+  if (denominator == 0) {
+    return OnSegment(a, b, c) || OnSegment(a, b, d) || OnSegment(c, d, a) ||
+           OnSegment(c, d, b);
+  }
+  __int128 t = Cross(Sub(c, a), s);
+  __int128 u = Cross(Sub(c, a), r);
+  if (denominator < 0) {
+    denominator = -denominator;
+    t = -t;
+    u = -u;
+  }
+  return t >= 0 && t <= denominator && u >= 0 && u <= denominator;
+}
+
+inline bool RayContains(Vec origin, Vec direction, Vec p) {
+  Vec offset = Sub(p, origin);
+  return Cross(direction, offset) == 0 && Dot(direction, offset) >= 0;
+}
+
+// Solves origin + t direction = a + u (b - a) with t >= 0, u in [0, 1].
+inline bool RayMeetsSegment(Vec origin, Vec direction, Vec a, Vec b) {
+  Vec s = Sub(b, a);
+  __int128 denominator = Cross(direction, s);
+  if (denominator == 0) {
+    return RayContains(origin, direction, a) ||
+           RayContains(origin, direction, b);
+  }
+  __int128 t = Cross(Sub(a, origin), s);
+  __int128 u = Cross(Sub(a, origin), direction);
+  if (denominator < 0) {
+    denominator = -denominator;
+    t = -t;
+    u = -u;
+  }
+  return t >= 0 && u >= 0 && u <= denominator;
+}
+
+inline bool LineContains(Vec first, Vec second, Vec p) {
+  return Cross(Sub(second, first), Sub(p, first)) == 0;
+}
+
+// A line meets a segment iff the segment's ends are not strictly on one
+// side of it.
+inline bool LineMeetsSegment(Vec first, Vec second, Vec a, Vec b) {
+  __int128 side_a = Cross(Sub(second, first), Sub(a, first));
+  __int128 side_b = Cross(Sub(second, first), Sub(b, first));
+  return !(side_a > 0 && side_b > 0) && !(side_a < 0 && side_b < 0);
+}
+
+inline bool DiskContains(Vec center, long long radius, Vec p) {
+  Vec offset = Sub(p, center);
+  return Dot(offset, offset) <= static_cast<__int128>(radius) * radius;
+}
+
+// f(t) = |a + t (b - a) - center|^2 - radius^2 = l t^2 + 2 p t + q is
+// convex, so it has a root in [0, 1] iff it is not negative at an end and
+// not positive at an end or at its vertex t = -p / l, where l f = l q - p^2.
+inline bool CircleMeetsSegment(Vec center, long long radius, Vec a, Vec b) {
+  Vec direction = Sub(b, a);
+  Vec offset = Sub(a, center);
+  __int128 l = Dot(direction, direction);
+  __int128 p = Dot(direction, offset);
+  __int128 q = Dot(offset, offset) - static_cast<__int128>(radius) * radius;
+  __int128 at_begin = q;
+  __int128 at_end = l + 2 * p + q;
+
+  bool not_all_negative = at_begin >= 0 || at_end >= 0;
+  bool vertex_inside = -p > 0 && -p < l && l * q - p * p <= 0;
+  bool not_all_positive = at_begin <= 0 || at_end <= 0 || vertex_inside;
+  return not_all_negative && not_all_positive;
+}
+
+// Squared distances as numerator / denominator.
+struct Fraction {
+  __int128 numerator;
+  __int128 denominator;
+};
+
+// Squared distance from p to the nearest point a + t / length2 * direction,
+// with t = (p - a) * direction clamped to [0, length2] for segments and to
+// t >= 0 for rays. Exact for coordinates below 2^19.
+inline Fraction LinearDistance2(Vec a, Vec direction, Vec p, bool from_a,
+                                bool to_end) {
+  Vec offset = Sub(p, a);
+  __int128 length2 = Dot(direction, direction);
+  if (length2 == 0) {
+    return {Dot(offset, offset), 1};
+  }
+  __int128 t = Dot(offset, direction);
+  if (from_a && t < 0) {
+    t = 0;
+  }
+  if (to_end && t > length2) {
+    t = length2;
+  }
+  __int128 x = length2 * offset.x - t * direction.x;
+  __int128 y = length2 * offset.y - t * direction.y;
+  return {x * x + y * y, length2 * length2};
+}
+
+inline Fraction SegmentDistance2(Vec a, Vec b, Vec p) {
+  return LinearDistance2(a, Sub(b, a), p, true, true);
+}
+
+inline Fraction RayDistance2(Vec origin, Vec direction, Vec p) {
+  return LinearDistance2(origin, direction, p, true, false);
+}
+
+inline Fraction LineDistance2(Vec first, Vec second, Vec p) {
+  return LinearDistance2(first, Sub(second, first), p, false, false);
+}
+
+// (sqrt(d2) - r)^2 for p outside the disk, rounded up: the least k with
+// sqrt(k) >= sqrt(d2) - r, found by bisection on
+// (d2 - r^2 - k)^2 <= 4 r^2 k. Exact for coordinates below 2^19.
+inline __int128 DiskDistance2(Vec center, long long radius, Vec p) {
+  __int128 distance2 = Dot(Sub(p, center), Sub(p, center));
+  __int128 radius2 = static_cast<__int128>(radius) * radius;
+  if (distance2 <= radius2) {
+    return 0;
+  }
+  auto enough = [&](__int128 k) {
+    __int128 rest = distance2 - radius2 - k;
+    return rest <= 0 || rest * rest <= 4 * radius2 * k;
+  };
+  __int128 low = 0;
+  __int128 high = distance2;
+  while (high - low > 1) {
+    __int128 middle = (low + high) / 2;
+    if (enough(middle)) {
+      high = middle;
+    } else {
+      low = middle;
+    }
+  }
+  return high;
+}
+
+// Winding number with the boundary included; equal to the even-odd rule for
+// simple polygons.
+inline bool PolygonContains(const std::vector<Vec>& vertexes, Vec p) {
+  size_t size = vertexes.size();
+  int winding = 0;
+  for (size_t i = 0; i < size; ++i) {
+    Vec a = vertexes[i];
+    Vec b = vertexes[(i + 1) % size];
+    if (OnSegment(a, b, p)) {
+      return true;
+    }
+    __int128 side = Cross(Sub(b, a), Sub(p, a));
+    if (a.y <= p.y && b.y > p.y && side > 0) {
+      ++winding;
+    } else if (b.y <= p.y && a.y > p.y && side < 0) {
+      --winding;
+    }
+  }
+  return winding != 0;
+}
+
+// The closing edge is left out, as in Polygon::CrossesSegment.
+inline bool PolygonMeetsSegment(const std::vector<Vec>& vertexes, Vec a,
+                                Vec b) {
+  for (size_t i = 0; i + 1 < vertexes.size(); ++i) {
+    if (SegmentsMeet(vertexes[i], vertexes[i + 1], a, b)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace Reference
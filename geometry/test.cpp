@@ -0,0 +1,1090 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "geometry.hpp"
+#include "reference.hpp"
+
+namespace {
+
+using Geometry::Circle;
+using Geometry::IShape;
+using Geometry::Line;
+using Geometry::Point;
+using Geometry::Polygon;
+using Geometry::Ray;
+using Geometry::Segment;
+using Geometry::Vector;
+
+Reference::Vec ToReference(const Point& point) {
+  return {point.point.x, point.point.y};
+}
+
+std::vector<Reference::Vec> ToReference(const std::vector<Point>& points) {
+  std::vector<Reference::Vec> result;
+  for (const Point& point : points) {
+    result.push_back(ToReference(point));
+  }
+  return result;
+}
+
+class Generator {
+ public:
+  explicit Generator(unsigned seed) : random_(seed) {}
+
+  int Coordinate(int limit) {
+    return std::uniform_int_distribution<int>(-limit, limit)(random_);
+  }
+
+  Point MakePoint(int limit) {
+    return Point(Coordinate(limit), Coordinate(limit));
+  }
+
+  Segment MakeSegment(int limit) {
+    return Segment(MakePoint(limit), MakePoint(limit));
+  }
+
+  // Vertexes at sorted angles around the origin: on one circle for convex
+  // polygons, at random distances in [radius / 4, radius] otherwise.
+  std::vector<Point> MakePolygon(size_t size, int radius, bool concave) {
+    std::uniform_real_distribution<double> angle(0, 2 * M_PI);
+    std::uniform_real_distribution<double> scale(0.25, 1);
+    std::vector<double> angles(size);
+    for (double& value : angles) {
+      value = angle(random_);
+    }
+    std::sort(angles.begin(), angles.end());
+
+    std::vector<Point> vertexes;
+    for (double value : angles) {
+      double distance = concave ? radius * scale(random_) : radius;
+      vertexes.emplace_back(static_cast<int>(distance * std::cos(value)),
+                            static_cast<int>(distance * std::sin(value)));
+    }
+    return vertexes;
+  }
+
+ private:
+  std::mt19937 random_;
+};
+
+// Small limits make collinear, touching and repeated points common; large
+// ones exercise the exact arithmetic.
+const int kLimits[] = {4, 1000, 1 << 29, 2147483647};
+
+TEST(PointTest, MatchesReference) {
+  Generator generator(1);
+  for (int limit : {2, 1000}) {
+    for (int i = 0; i < 2000; ++i) {
+      Point point = generator.MakePoint(limit);
+      Point other = generator.MakePoint(limit);
+      Segment segment = generator.MakeSegment(limit);
+      auto borders = segment.GetBorders();
+
+      EXPECT_EQ(point.ContainsPoint(other),
+                Reference::Equal(ToReference(point), ToReference(other)));
+      EXPECT_EQ(point.CrossesSegment(segment),
+                Reference::OnSegment(ToReference(borders.first),
+                                     ToReference(borders.second),
+                                     ToReference(point)));
+    }
+  }
+}
+
+TEST(SegmentTest, MatchesReference) {
+  Generator generator(2);
+  for (int limit : kLimits) {
+    for (int i = 0; i < 5000; ++i) {
+      Point a = generator.MakePoint(limit);
+      Point b = generator.MakePoint(limit);
+      Point p = generator.MakePoint(limit);
+      Segment other = generator.MakeSegment(limit);
+      auto borders = other.GetBorders();
+
+      EXPECT_EQ(Segment(a, b).ContainsPoint(p),
+                Reference::OnSegment(ToReference(a), ToReference(b),
+                                     ToReference(p)));
+      EXPECT_EQ(Segment(a, b).CrossesSegment(other),
+                Reference::SegmentsMeet(ToReference(a), ToReference(b),
+                                        ToReference(borders.first),
+                                        ToReference(borders.second)));
+    }
+  }
+}
+
+TEST(SegmentTest, Degenerate) {
+  Segment point(Point(1, 1), Point(1, 1));
+  EXPECT_TRUE(point.ContainsPoint(Point(1, 1)));
+  EXPECT_FALSE(point.ContainsPoint(Point(2, 2)));
+  EXPECT_TRUE(point.CrossesSegment(Segment(Point(0, 0), Point(2, 2))));
+  EXPECT_FALSE(point.CrossesSegment(Segment(Point(0, 0), Point(2, 1))));
+
+  Segment segment(Point(0, 0), Point(4, 0));
+  EXPECT_TRUE(segment.CrossesSegment(Segment(Point(4, 0), Point(6, 0))));
+  EXPECT_TRUE(segment.CrossesSegment(Segment(Point(1, 0), Point(3, 0))));
+  EXPECT_FALSE(segment.CrossesSegment(Segment(Point(5, 0), Point(6, 0))));
+  EXPECT_TRUE(segment.CrossesSegment(Segment(Point(2, 0), Point(2, 5))));
+}
+
+TEST(RayTest, MatchesReference) {
+  Generator generator(3);
+  for (int limit : kLimits) {
+    for (int i = 0; i < 5000; ++i) {
+      Point origin = generator.MakePoint(limit);
+      Vector direction(generator.Coordinate(limit),
+                       generator.Coordinate(limit));
+      if (direction == Vector(0, 0)) {
+        continue;
+      }
+      Ray ray(origin, direction);
+      Point p = generator.MakePoint(limit);
+      Segment other = generator.MakeSegment(limit);
+      auto borders = other.GetBorders();
+      Reference::Vec reference_direction{direction.x, direction.y};
+
+      EXPECT_EQ(ray.ContainsPoint(p),
+                Reference::RayContains(ToReference(origin),
+                                       reference_direction, ToReference(p)));
+      EXPECT_EQ(ray.CrossesSegment(other),
+                Reference::RayMeetsSegment(
+                    ToReference(origin), reference_direction,
+                    ToReference(borders.first), ToReference(borders.second)));
+    }
+  }
+}
+
+TEST(LineTest, MatchesReference) {
+  Generator generator(4);
+  for (int limit : kLimits) {
+    for (int i = 0; i < 5000; ++i) {
+      Point first = generator.MakePoint(limit);
+      Point second = generator.MakePoint(limit);
+      if (first.point == second.point) {
+        continue;
+      }
+      Line line(first, second);
+      Point p = generator.MakePoint(limit);
+      Segment other = generator.MakeSegment(limit);
+      auto borders = other.GetBorders();
+
+      EXPECT_EQ(line.ContainsPoint(p),
+                Reference::LineContains(ToReference(first),
+                                        ToReference(second), ToReference(p)));
+      EXPECT_EQ(line.CrossesSegment(other),
+                Reference::LineMeetsSegment(
+                    ToReference(first), ToReference(second),
+                    ToReference(borders.first), ToReference(borders.second)));
+    }
+  }
+}
+
+TEST(CircleTest, MatchesReference) {
+  Generator generator(5);
+  for (int limit : {4, 1000, 1 << 29}) {
+    for (int i = 0; i < 5000; ++i) {
+      Point center = generator.MakePoint(limit);
+      int radius = std::abs(generator.Coordinate(limit));
+      Circle circle(center, radius);
+      Point p = generator.MakePoint(limit);
+      Segment other = generator.MakeSegment(limit);
+      auto borders = other.GetBorders();
+
+      EXPECT_EQ(circle.ContainsPoint(p),
+                Reference::DiskContains(ToReference(center), radius,
+                                        ToReference(p)));
+      EXPECT_EQ(circle.CrossesSegment(other),
+                Reference::CircleMeetsSegment(ToReference(center), radius,
+                                              ToReference(borders.first),
+                                              ToReference(borders.second)));
+    }
+  }
+}
+
+TEST(CircleTest, Tangents) {
+  Circle circle(Point(0, 0), 5);
+  EXPECT_TRUE(circle.CrossesSegment(Segment(Point(-10, 5), Point(10, 5))));
+  EXPECT_FALSE(circle.CrossesSegment(Segment(Point(-10, 6), Point(10, 6))));
+  EXPECT_TRUE(circle.CrossesSegment(Segment(Point(3, 4), Point(3, 4))));
+  EXPECT_FALSE(circle.CrossesSegment(Segment(Point(1, 1), Point(2, 2))));
+  EXPECT_TRUE(circle.ContainsPoint(Point(-3, -4)));
+  EXPECT_FALSE(circle.ContainsPoint(Point(4, 4)));
+}
+
+void ExpectPolygonMatches(const std::vector<Point>& vertexes, int limit,
+                          Generator* generator) {
+  Polygon polygon(vertexes);
+  std::vector<Reference::Vec> reference = ToReference(vertexes);
+
+  std::vector<Point> queries(vertexes);
+  for (size_t i = 0; i + 1 < vertexes.size(); ++i) {
+    const Vector& a = vertexes[i].point;
+    const Vector& b = vertexes[i + 1].point;
+    queries.emplace_back(a.x / 2 + b.x / 2, a.y / 2 + b.y / 2);
+  }
+  for (int i = 0; i < 300; ++i) {
+    queries.push_back(generator->MakePoint(limit));
+  }
+
+  for (const Point& query : queries) {
+    EXPECT_EQ(polygon.ContainsPoint(query),
+              Reference::PolygonContains(reference, ToReference(query)))
+        << query.point.x << " " << query.point.y;
+  }
+  for (int i = 0; i < 300; ++i) {
+    Point begin = queries[i % queries.size()];
+    Point end = generator->MakePoint(limit);
+    EXPECT_EQ(polygon.CrossesSegment(Segment(begin, end)),
+              Reference::PolygonMeetsSegment(reference, ToReference(begin),
+                                             ToReference(end)));
+  }
+}
+
+TEST(PolygonTest, ConvexMatchesReference) {
+  Generator generator(6);
+  for (size_t size : {3, 10, 63, 64, 65, 500, 3000}) {
+    for (int radius : {10, 100000, 1 << 30}) {
+      ExpectPolygonMatches(generator.MakePolygon(size, radius, false),
+                           radius + radius / 4, &generator);
+    }
+  }
+}
+
+TEST(PolygonTest, ConcaveMatchesReference) {
+  Generator generator(7);
+  for (size_t size : {3, 10, 63, 64, 65, 500, 3000}) {
+    for (int radius : {10, 100000, 1 << 30}) {
+      ExpectPolygonMatches(generator.MakePolygon(size, radius, true),
+                           radius + radius / 4, &generator);
+    }
+  }
+}
+
+TEST(PolygonTest, DegenerateVertexes) {
+  Generator generator(8);
+  std::vector<std::vector<Point>> polygons = {
+      {Point(0, 0)},
+      {Point(0, 0), Point(5, 5)},
+      {Point(0, 0), Point(5, 0), Point(10, 0)},
+      {Point(0, 0), Point(0, 0), Point(4, 0), Point(4, 4), Point(4, 4)},
+      {Point(0, 0), Point(2, 0), Point(4, 0), Point(4, 2), Point(4, 4),
+       Point(2, 4), Point(0, 4), Point(0, 2)},
+      {Point(0, 0), Point(6, 0), Point(6, 6), Point(4, 6), Point(4, 2),
+       Point(2, 2), Point(2, 6), Point(0, 6)},
+  };
+  for (const auto& vertexes : polygons) {
+    ExpectPolygonMatches(vertexes, 8, &generator);
+  }
+}
+
+TEST(PolygonTest, ClosingEdgeIsNotCrossed) {
+  Polygon polygon({Point(0, 0), Point(4, 0), Point(4, 4), Point(0, 4)});
+  EXPECT_FALSE(polygon.CrossesSegment(Segment(Point(-1, 2), Point(1, 2))));
+  EXPECT_TRUE(polygon.CrossesSegment(Segment(Point(3, 2), Point(5, 2))));
+}
+
+TEST(BatchTest, MatchesScalar) {
+  Generator generator(9);
+  std::vector<std::unique_ptr<IShape>> shapes;
+  shapes.emplace_back(new Point(1, 2));
+  shapes.emplace_back(new Segment(Point(-50, -20), Point(70, 40)));
+  shapes.emplace_back(new Ray(Point(-3, 7), Vector(2, -1)));
+  shapes.emplace_back(new Line(Point(-3, 7), Point(5, 3)));
+  shapes.emplace_back(new Circle(Point(10, -5), 60));
+  shapes.emplace_back(new Polygon(generator.MakePolygon(40, 90, true)));
+  shapes.emplace_back(new Polygon(generator.MakePolygon(2000, 90, true)));
+
+  std::vector<int> xs;
+  std::vector<int> ys;
+  for (int i = 0; i < 3000; ++i) {
+    xs.push_back(generator.Coordinate(100));
+    ys.push_back(generator.Coordinate(100));
+  }
+  for (const auto& shape : shapes) {
+    std::vector<uint8_t> out(xs.size());
+    shape->ContainsPoints(xs.data(), ys.data(), xs.size(), out.data());
+    for (size_t i = 0; i < xs.size(); ++i) {
+      EXPECT_EQ(out[i] != 0, shape->ContainsPoint(Point(xs[i], ys[i])));
+    }
+  }
+}
+
+// Shapes and points on both sides of 2^30, where the batch kernels leave
+// 64-bit lanes for exact arithmetic. One far point moves a whole batch.
+TEST(BatchTest, LargeCoordinatesMatchScalar) {
+  Generator generator(14);
+  for (int limit : kLimits) {
+    Point a = generator.MakePoint(limit / 2);
+    Point b = generator.MakePoint(limit / 2);
+    std::vector<std::unique_ptr<IShape>> shapes;
+    shapes.emplace_back(new Segment(a, b));
+    shapes.emplace_back(new Ray(a, Vector(3, -2)));
+    shapes.emplace_back(new Line(a, b));
+    shapes.emplace_back(new Circle(a, limit / 2));
+    shapes.emplace_back(
+        new Polygon(generator.MakePolygon(50, limit / 2, true)));
+
+    for (bool far : {false, true}) {
+      std::vector<int> xs = {a.point.x, b.point.x};
+      std::vector<int> ys = {a.point.y, b.point.y};
+      for (int k = -5; k <= 5; ++k) {
+        xs.push_back(a.point.x + 3 * k);
+        ys.push_back(a.point.y - 2 * k);
+      }
+      for (int i = 0; i < 1000; ++i) {
+        xs.push_back(generator.Coordinate(limit / 2));
+        ys.push_back(generator.Coordinate(limit / 2));
+      }
+      if (far) {
+        xs.push_back(std::numeric_limits<int>::max());
+        ys.push_back(std::numeric_limits<int>::min());
+      }
+      for (const auto& shape : shapes) {
+        std::vector<uint8_t> out(xs.size());
+        shape->ContainsPoints(xs.data(), ys.data(), xs.size(), out.data());
+        for (size_t i = 0; i < xs.size(); ++i) {
+          EXPECT_EQ(out[i] != 0, shape->ContainsPoint(Point(xs[i], ys[i])))
+              << shape->ToString() << " " << xs[i] << " " << ys[i];
+        }
+      }
+    }
+  }
+}
+
+TEST(RasterCacheTest, MatchesUncached) {
+  Generator generator(10);
+  for (size_t size : {10, 200, 5000}) {
+    for (size_t memory : {64, 4096, 1 << 20}) {
+      std::vector<Point> vertexes = generator.MakePolygon(size, 100000, true);
+      Polygon plain(vertexes);
+      Polygon cached(vertexes);
+      cached.EnableRasterCache(memory);
+
+      std::vector<int> xs;
+      std::vector<int> ys;
+      for (int i = 0; i < 2000; ++i) {
+        xs.push_back(generator.Coordinate(130000));
+        ys.push_back(generator.Coordinate(130000));
+      }
+      std::vector<uint8_t> out(xs.size());
+      cached.ContainsPoints(xs.data(), ys.data(), xs.size(), out.data());
+      for (size_t i = 0; i < xs.size(); ++i) {
+        bool expected = plain.ContainsPoint(Point(xs[i], ys[i]));
+        EXPECT_EQ(cached.ContainsPoint(Point(xs[i], ys[i])), expected);
+        EXPECT_EQ(out[i] != 0, expected);
+      }
+
+      Geometry::RasterCacheStats stats = cached.GetRasterCacheStats();
+      EXPECT_EQ(stats.lookups, 2 * xs.size());
+      EXPECT_LE(stats.hits, stats.lookups);
+      EXPECT_GT(stats.memory_bytes, 0u);
+    }
+  }
+}
+
+// Small polygons on small grids, checked at every integer point: edges run
+// between neighbouring cells, and regions span several blocks.
+TEST(RasterCacheTest, EveryPointOfSmallPolygons) {
+  std::mt19937 random(13);
+  std::uniform_int_distribution<int> coordinate(0, 60);
+  for (int polygon = 0; polygon < 300; ++polygon) {
+    std::vector<Point> vertexes;
+    for (int i = 0; i < 3 + polygon % 10; ++i) {
+      vertexes.emplace_back(coordinate(random), coordinate(random));
+    }
+    Polygon plain(vertexes);
+    for (size_t memory : {64, 256, 1024, 4096}) {
+      Polygon cached(vertexes);
+      cached.EnableRasterCache(memory);
+      for (int x = -2; x <= 62; ++x) {
+        for (int y = -2; y <= 62; ++y) {
+          ASSERT_EQ(cached.ContainsPoint(Point(x, y)),
+                    plain.ContainsPoint(Point(x, y)))
+              << cached.ToString() << " " << memory << " " << x << " " << y;
+        }
+      }
+    }
+  }
+}
+
+// With floating point coordinates a grid corner may lie on an edge, where
+// the orientation test can round either way; such cells must not be taken
+// as inside or outside.
+TEST(RasterCacheTest, DoubleCornersOnEdges) {
+  using RealPoint = Geometry::BasicPoint<double>;
+  using RealPolygon = Geometry::BasicPolygon<double>;
+
+  RealPolygon triangle({RealPoint(-614.5383689646651, -906.73630819333152),
+                        RealPoint(-896.99084013684944, -481.42553846792612),
+                        RealPoint(-818.99829524592053, -727.7297966199568)});
+  triangle.EnableRasterCache(64);
+  RealPoint outside(-625.75072577167202, -556.3435308755511);
+  EXPECT_FALSE(triangle.ContainsPoint(outside));
+
+  std::mt19937 random(12);
+  std::uniform_real_distribution<double> coordinate(-1000, 1000);
+  for (int polygon = 0; polygon < 200; ++polygon) {
+    std::vector<RealPoint> vertexes;
+    for (int i = 0; i < 3 + polygon % 5; ++i) {
+      vertexes.emplace_back(coordinate(random), coordinate(random));
+    }
+    RealPolygon plain(vertexes);
+    RealPolygon cached(vertexes);
+    cached.EnableRasterCache(polygon % 2 ? 64 : 4096);
+    for (int i = 0; i < 500; ++i) {
+      RealPoint query(coordinate(random), coordinate(random));
+      EXPECT_EQ(cached.ContainsPoint(query), plain.ContainsPoint(query));
+    }
+  }
+}
+
+TEST(MoveTest, LazyOffsetMatchesMaterialized) {
+  Generator generator(11);
+  for (bool cached : {false, true}) {
+    std::vector<Point> vertexes = generator.MakePolygon(300, 1000, true);
+    Polygon lazy(vertexes);
+    if (cached) {
+      lazy.EnableRasterCache(1 << 14);
+    }
+    for (int step = 0; step < 5; ++step) {
+      Vector shift(generator.Coordinate(1 << 27),
+                   generator.Coordinate(1 << 27));
+      lazy.Move(shift);
+      for (Point& vertex : vertexes) {
+        vertex.point += shift;
+      }
+      Polygon moved(vertexes);
+      Polygon materialized(lazy);
+      materialized.Materialize();
+      EXPECT_EQ(lazy.ToString(), moved.ToString());
+      EXPECT_EQ(materialized.ToString(), moved.ToString());
+
+      const Vector& anchor = vertexes[0].point;
+      for (int i = 0; i < 500; ++i) {
+        Point query(anchor.x + generator.Coordinate(2500),
+                    anchor.y + generator.Coordinate(2500));
+        Point far = generator.MakePoint(2147483647);
+        EXPECT_EQ(lazy.ContainsPoint(query), moved.ContainsPoint(query));
+        EXPECT_EQ(lazy.ContainsPoint(far), moved.ContainsPoint(far));
+        EXPECT_EQ(materialized.ContainsPoint(query),
+                  moved.ContainsPoint(query));
+        Segment segment(query, i % 2 ? far : generator.MakePoint(1 << 29));
+        EXPECT_EQ(lazy.CrossesSegment(segment), moved.CrossesSegment(segment));
+      }
+    }
+  }
+}
+
+// Two moves whose sum is past the range of int bring the polygon back into
+// range; the pending offset must not overflow on the way.
+TEST(MoveTest, OffsetPastRangeOfT) {
+  Polygon polygon({Point(-2000000000, 0), Point(-1999999990, 0),
+                   Point(-1999999990, 10)});
+  polygon.Move(Vector(1500000000, 0));
+  polygon.Move(Vector(1500000000, 0));
+  EXPECT_TRUE(polygon.ContainsPoint(Point(1000000005, 1)));
+  EXPECT_FALSE(polygon.ContainsPoint(Point(1000000005, 9)));
+  EXPECT_FALSE(polygon.ContainsPoint(Point(-1999999995, 1)));
+  EXPECT_TRUE(polygon.CrossesSegment(
+      Segment(Point(1000000015, 5), Point(-2000000000, 5))));
+  EXPECT_FALSE(polygon.CrossesSegment(
+      Segment(Point(1000000015, 15), Point(-2000000000, 15))));
+  EXPECT_EQ(polygon.SquaredDistance(Point(-2000000000, 0)),
+            Geometry::Distance2(3000000000ll * 3000000000ll));
+  EXPECT_EQ(polygon.ToString(),
+            "Polygon(Point(1000000000, 0), Point(1000000010, 0), "
+            "Point(1000000010, 10))");
+
+  Polygon materialized(polygon);
+  materialized.Materialize();
+  EXPECT_EQ(materialized.ToString(), polygon.ToString());
+  EXPECT_TRUE(materialized.ContainsPoint(Point(1000000005, 1)));
+}
+
+TEST(FindIntersectionsTest, MatchesPairwise) {
+  Generator generator(12);
+  for (int limit : {3, 50, 1 << 29, 2147483647}) {
+    for (size_t count : {0, 1, 2, 40, 300}) {
+      std::vector<Segment> segments;
+      for (size_t i = 0; i < count; ++i) {
+        segments.push_back(generator.MakeSegment(limit));
+      }
+
+      std::vector<std::pair<size_t, size_t>> expected;
+      for (size_t i = 0; i < count; ++i) {
+        for (size_t j = i + 1; j < count; ++j) {
+          auto first = segments[i].GetBorders();
+          auto second = segments[j].GetBorders();
+          if (Reference::SegmentsMeet(
+                  ToReference(first.first), ToReference(first.second),
+                  ToReference(second.first), ToReference(second.second))) {
+            expected.emplace_back(i, j);
+          }
+        }
+      }
+      EXPECT_EQ(Geometry::FindIntersections(segments), expected);
+    }
+  }
+}
+
+// Map data is full of collinear overlaps: each such pair meets along a
+// whole stretch of events and must still be reported once.
+TEST(FindIntersectionsTest, OverlappingCollinear) {
+  std::vector<Segment> segments;
+  for (int i = 0; i < 2000; ++i) {
+    segments.emplace_back(Point(i, 0), Point(i + 100000, 0));
+  }
+  for (int i = 0; i < 100; ++i) {
+    segments.emplace_back(Point(3 * i, 3 * i), Point(3 * i + 500, 3 * i + 500));
+    segments.emplace_back(Point(1000 * i, -10), Point(1000 * i, 10));
+  }
+
+  std::vector<std::pair<size_t, size_t>> expected;
+  for (size_t i = 0; i < segments.size(); ++i) {
+    for (size_t j = i + 1; j < segments.size(); ++j) {
+      auto first = segments[i].GetBorders();
+      auto second = segments[j].GetBorders();
+      if (Reference::SegmentsMeet(
+              ToReference(first.first), ToReference(first.second),
+              ToReference(second.first), ToReference(second.second))) {
+        expected.emplace_back(i, j);
+      }
+    }
+  }
+  EXPECT_EQ(Geometry::FindIntersections(segments), expected);
+}
+
+TEST(QueryEngineTest, MatchesSerial) {
+  Generator generator(13);
+  Polygon polygon(generator.MakePolygon(500, 300, true));
+  Circle circle(Point(20, -40), 150);
+  Segment segment(Point(-300, -100), Point(250, 200));
+  std::vector<const IShape*> shapes = {&polygon, &circle, &segment};
+
+  std::vector<Point> points;
+  std::vector<Segment> segments;
+  for (int i = 0; i < 3000; ++i) {
+    points.push_back(generator.MakePoint(400));
+    segments.push_back(generator.MakeSegment(400));
+  }
+
+  std::vector<std::pair<size_t, size_t>> contained;
+  std::vector<std::pair<size_t, size_t>> crossed;
+  for (size_t i = 0; i < points.size(); ++i) {
+    for (size_t j = 0; j < shapes.size(); ++j) {
+      if (shapes[j]->ContainsPoint(points[i])) {
+        contained.emplace_back(i, j);
+      }
+      if (shapes[j]->CrossesSegment(segments[i])) {
+        crossed.emplace_back(i, j);
+      }
+    }
+  }
+
+  for (size_t threads : {1, 2, 4}) {
+    Geometry::QueryEngine engine(threads);
+    EXPECT_EQ(engine.ContainsPoints(points, shapes), contained);
+    EXPECT_EQ(engine.CrossesSegments(segments, shapes), crossed);
+    EXPECT_TRUE(engine.ContainsPoints({}, shapes).empty());
+  }
+}
+
+// Distances are compared as fractions through exact 256-bit products.
+int CompareFractions(const Geometry::Distance2& distance,
+                     const Reference::Fraction& expected) {
+  __int128 numerator = distance.whole * distance.denominator +
+                       distance.remainder;
+  return Geometry::CompareProducts(numerator, expected.denominator,
+                                   expected.numerator, distance.denominator);
+}
+
+TEST(DistanceTest, MatchesReference) {
+  Generator generator(16);
+  for (int limit : {4, 1000, 1 << 18}) {
+    for (int i = 0; i < 5000; ++i) {
+      Point a = generator.MakePoint(limit);
+      Point b = generator.MakePoint(limit);
+      Point p = generator.MakePoint(limit);
+      Point q = generator.MakePoint(limit);
+      Segment segment(a, b);
+      Reference::Vec direction{b.point.x - a.point.x, b.point.y - a.point.y};
+
+      Reference::Vec offset = Reference::Sub(ToReference(p), ToReference(a));
+      EXPECT_EQ(CompareFractions(a.SquaredDistance(p),
+                                 {Reference::Dot(offset, offset), 1}),
+                0);
+      EXPECT_EQ(CompareFractions(segment.SquaredDistance(p),
+                                 Reference::SegmentDistance2(
+                                     ToReference(a), ToReference(b),
+                                     ToReference(p))),
+                0);
+      EXPECT_EQ(segment.SquaredDistance(p) == Geometry::Distance2(0),
+                segment.ContainsPoint(p));
+
+      // The order of two distances is exact even when they are close.
+      Reference::Fraction first = Reference::SegmentDistance2(
+          ToReference(a), ToReference(b), ToReference(p));
+      Reference::Fraction second = Reference::SegmentDistance2(
+          ToReference(a), ToReference(b), ToReference(q));
+      int expected_order =
+          Geometry::CompareProducts(first.numerator, second.denominator,
+                                    second.numerator, first.denominator);
+      auto order = segment.SquaredDistance(p) <=> segment.SquaredDistance(q);
+      EXPECT_EQ(order < 0, expected_order < 0);
+      EXPECT_EQ(order == 0, expected_order == 0);
+
+      if (!(a.point == b.point)) {
+        Ray ray(a, b.point - a.point);
+        Line line(a, b);
+        EXPECT_EQ(CompareFractions(ray.SquaredDistance(p),
+                                   Reference::RayDistance2(
+                                       ToReference(a), direction,
+                                       ToReference(p))),
+                  0);
+        EXPECT_EQ(CompareFractions(line.SquaredDistance(p),
+                                   Reference::LineDistance2(
+                                       ToReference(a), ToReference(b),
+                                       ToReference(p))),
+                  0);
+      }
+
+      int radius = std::abs(generator.Coordinate(limit));
+      Circle circle(a, radius);
+      Geometry::Distance2 circle_distance = circle.SquaredDistance(p);
+      EXPECT_EQ(circle_distance.remainder, 0);
+      EXPECT_EQ(circle_distance.whole,
+                Reference::DiskDistance2(ToReference(a), radius,
+                                         ToReference(p)));
+    }
+  }
+}
+
+TEST(DistanceTest, LargeCoordinates) {
+  Generator generator(17);
+  for (int limit : {1 << 29, 2147483647}) {
+    for (int i = 0; i < 5000; ++i) {
+      Point a = generator.MakePoint(limit);
+      Point b = generator.MakePoint(limit);
+      Point p = generator.MakePoint(limit);
+      Segment segment(a, b);
+
+      Reference::Vec direction =
+          Reference::Sub(ToReference(b), ToReference(a));
+      Reference::Vec offset = Reference::Sub(ToReference(p), ToReference(a));
+      __int128 length2 = Reference::Dot(direction, direction);
+      __int128 projection = Reference::Dot(direction, offset);
+      long double expected = 0;
+      if (length2 == 0 || projection <= 0) {
+        expected = static_cast<long double>(Reference::Dot(offset, offset));
+      } else if (projection >= length2) {
+        Reference::Vec rest = Reference::Sub(ToReference(p), ToReference(b));
+        expected = static_cast<long double>(Reference::Dot(rest, rest));
+      } else {
+        long double cross = Reference::Cross(direction, offset);
+        expected = cross * cross / static_cast<long double>(length2);
+      }
+      EXPECT_NEAR(segment.SquaredDistance(p).ToDouble(), expected,
+                  expected * 1e-12 + 1e-9);
+
+      int radius = std::abs(generator.Coordinate(limit / 2));
+      Circle circle(a, radius);
+      long double gap =
+          std::sqrt(static_cast<long double>(Reference::Dot(offset, offset))) -
+          radius;
+      long double circle_expected = gap > 0 ? gap * gap : 0;
+      EXPECT_NEAR(circle.SquaredDistance(p).ToDouble(), circle_expected,
+                  circle_expected * 1e-12 + 1);
+      EXPECT_EQ(circle.SquaredDistance(p) == Geometry::Distance2(0),
+                circle.ContainsPoint(p));
+    }
+  }
+}
+
+TEST(DistanceTest, Degenerate) {
+  EXPECT_EQ(Ray(Point(1, 1), Vector(0, 0)).SquaredDistance(Point(5, 9)),
+            Geometry::Distance2(0));
+  EXPECT_EQ(Line(Point(1, 1), Point(1, 1)).SquaredDistance(Point(5, 9)),
+            Geometry::Distance2(0));
+  EXPECT_EQ(Segment(Point(1, 1), Point(1, 1)).SquaredDistance(Point(4, 5)),
+            Geometry::Distance2(25));
+  EXPECT_EQ(Ray(Point(0, 0), Vector(1, 0)).SquaredDistance(Point(-3, 4)),
+            Geometry::Distance2(25));
+
+  // (sqrt(2) - 1)^2 = 0.17... is rounded up; (5 - 2)^2 is exact.
+  EXPECT_EQ(Circle(Point(0, 0), 1).SquaredDistance(Point(1, 1)),
+            Geometry::Distance2(1));
+  EXPECT_EQ(Circle(Point(0, 0), 2).SquaredDistance(Point(3, 4)),
+            Geometry::Distance2(9));
+  EXPECT_EQ(Circle(Point(0, 0), 5).SquaredDistance(Point(3, 4)),
+            Geometry::Distance2(0));
+
+  // 64 / 10 and 32 / 5 are equal; 64 / 10 and 6 are not.
+  Geometry::Distance2 distance =
+      Segment(Point(0, 0), Point(3, 1)).SquaredDistance(Point(1, 3));
+  EXPECT_EQ(distance.whole, 6);
+  EXPECT_EQ(distance,
+            Line(Point(0, 0), Point(6, 2)).SquaredDistance(Point(1, 3)));
+  EXPECT_GT(distance, Geometry::Distance2(6));
+  EXPECT_LT(distance, Geometry::Distance2(7));
+  EXPECT_DOUBLE_EQ(distance.ToDouble(), 6.4);
+}
+
+// Scaling the coordinates by 2^40 scales squared distances by 2^80, which
+// takes the long long ones past 128 bits before the division.
+TEST(DistanceTest, LongLongAndDouble) {
+  Generator generator(20);
+  const long long kScale = 1LL << 40;
+  const __int128 kScale2 = static_cast<__int128>(kScale) * kScale;
+  auto wide = [&](const Point& point) {
+    return Geometry::BasicPoint<long long>(point.point.x * kScale,
+                                           point.point.y * kScale);
+  };
+  auto real = [](const Point& point) {
+    return Geometry::BasicPoint<double>(point.point.x, point.point.y);
+  };
+
+  for (int i = 0; i < 3000; ++i) {
+    Point a = generator.MakePoint(20);
+    Point b = generator.MakePoint(20);
+    Point p = generator.MakePoint(20);
+    Geometry::Distance2 distance = Segment(a, b).SquaredDistance(p);
+
+    Geometry::BasicDistance2<long long> wide_distance =
+        Geometry::BasicSegment<long long>(wide(a), wide(b))
+            .SquaredDistance(wide(p));
+    __int128 scaled_remainder = distance.remainder * kScale2;
+    EXPECT_TRUE(wide_distance.whole ==
+                distance.whole * kScale2 +
+                    scaled_remainder / distance.denominator);
+    EXPECT_TRUE(wide_distance.remainder * distance.denominator ==
+                scaled_remainder % distance.denominator *
+                    wide_distance.denominator);
+
+    Geometry::BasicDistance2<double> real_distance =
+        Geometry::BasicSegment<double>(real(a), real(b))
+            .SquaredDistance(real(p));
+    EXPECT_NEAR(real_distance.ToDouble(), distance.ToDouble(), 1e-9);
+
+    int radius = std::abs(generator.Coordinate(20));
+    EXPECT_NEAR(Geometry::BasicCircle<double>(real(a), radius)
+                    .SquaredDistance(real(p))
+                    .ToDouble(),
+                Circle(a, radius).SquaredDistance(p).ToDouble(), 1);
+  }
+}
+
+TEST(DistanceTest, PolygonMatchesEdges) {
+  Generator generator(18);
+  for (size_t size : {3, 10, 63, 64, 65, 500, 3000}) {
+    for (bool concave : {false, true}) {
+      std::vector<Point> vertexes =
+          generator.MakePolygon(size, 1 << 20, concave);
+      Polygon polygon(vertexes);
+      Polygon moved(polygon);
+      Vector shift(generator.Coordinate(1 << 30),
+                   generator.Coordinate(1 << 30));
+      moved.Move(shift);
+      Polygon materialized(moved);
+      materialized.Materialize();
+
+      for (int i = 0; i < 300; ++i) {
+        Point query = generator.MakePoint((1 << 20) + (1 << 18));
+        Geometry::Distance2 expected;
+        for (size_t j = 0; j < size; ++j) {
+          Geometry::Distance2 edge =
+              Segment(vertexes[j], vertexes[(j + 1) % size])
+                  .SquaredDistance(query);
+          if (j == 0 || edge < expected) {
+            expected = edge;
+          }
+        }
+        if (polygon.ContainsPoint(query)) {
+          expected = Geometry::Distance2(0);
+        }
+        EXPECT_EQ(polygon.SquaredDistance(query), expected);
+
+        Point shifted(query.point + shift);
+        EXPECT_EQ(moved.SquaredDistance(shifted), expected);
+        Point far = generator.MakePoint(2147483647);
+        EXPECT_EQ(moved.SquaredDistance(far),
+                  materialized.SquaredDistance(far));
+      }
+    }
+  }
+}
+
+// Brute force over the items, by distance and then by index.
+std::vector<size_t> SortByDistance(const std::vector<Segment>& items,
+                                   const Point& query) {
+  std::vector<std::pair<Geometry::Distance2, size_t>> order;
+  for (size_t i = 0; i < items.size(); ++i) {
+    order.emplace_back(items[i].SquaredDistance(query), i);
+  }
+  std::sort(order.begin(), order.end());
+  std::vector<size_t> result;
+  for (const auto& entry : order) {
+    result.push_back(entry.second);
+  }
+  return result;
+}
+
+TEST(KdTreeTest, MatchesBruteForce) {
+  Generator generator(19);
+  for (int limit : {10, 1000, 1 << 29, 2147483647}) {
+    for (size_t count : {0, 1, 7, 8, 9, 100, 2000}) {
+      for (bool points : {true, false}) {
+        std::vector<Point> centers;
+        std::vector<Segment> items;
+        for (size_t i = 0; i < count; ++i) {
+          Point center = generator.MakePoint(limit);
+          Point end(center.point.x / 2 + generator.Coordinate(limit / 2),
+                    center.point.y / 2 + generator.Coordinate(limit / 2));
+          centers.push_back(center);
+          items.emplace_back(center, points ? center : end);
+        }
+        Geometry::KdTree tree = points ? Geometry::KdTree(centers)
+                                       : Geometry::KdTree(items);
+        EXPECT_EQ(tree.Size(), count);
+
+        for (int i = 0; i < 100; ++i) {
+          Point query = generator.MakePoint(limit);
+          std::vector<size_t> expected = SortByDistance(items, query);
+          if (count > 0) {
+            EXPECT_EQ(tree.Nearest(query), expected[0]);
+          }
+          for (size_t k : {0, 1, 5, 50}) {
+            std::vector<size_t> nearest(
+                expected.begin(),
+                expected.begin() + std::min(k, expected.size()));
+            EXPECT_EQ(tree.NearestK(query, k), nearest);
+          }
+
+          int radius = std::abs(generator.Coordinate(limit / 4));
+          Geometry::Distance2 limit2(static_cast<__int128>(radius) * radius);
+          std::vector<size_t> within;
+          for (size_t j = 0; j < count; ++j) {
+            if (items[j].SquaredDistance(query) <= limit2) {
+              within.push_back(j);
+            }
+          }
+          EXPECT_EQ(tree.WithinRadius(query, radius), within);
+        }
+      }
+    }
+  }
+}
+
+TEST(KdTreeTest, TiesGoToLowerIndexes) {
+  std::vector<Point> points = {Point(2, 0), Point(0, 2), Point(-2, 0),
+                               Point(2, 0), Point(0, -2), Point(5, 5)};
+  Geometry::KdTree tree(points);
+  EXPECT_EQ(tree.Nearest(Point(0, 0)), 0u);
+  EXPECT_EQ(tree.NearestK(Point(0, 0), 4),
+            (std::vector<size_t>{0, 1, 2, 3}));
+  EXPECT_EQ(tree.NearestK(Point(2, 0), 3), (std::vector<size_t>{0, 3, 1}));
+  EXPECT_EQ(tree.WithinRadius(Point(0, 0), 2),
+            (std::vector<size_t>{0, 1, 2, 3, 4}));
+  EXPECT_TRUE(tree.WithinRadius(Point(0, 0), 1).empty());
+
+  Geometry::KdTree roads({Segment(Point(-10, 1), Point(10, 1)),
+                          Segment(Point(0, -3), Point(0, -30))});
+  EXPECT_EQ(roads.Nearest(Point(7, -1)), 0u);
+  EXPECT_EQ(roads.Nearest(Point(1, -20)), 1u);
+}
+
+TEST(TextTest, ToStringFormat) {
+  EXPECT_EQ(Point(1, -2).ToString(), "Point(1, -2)");
+  EXPECT_EQ(Segment(Point(0, 0), Point(3, 4)).ToString(),
+            "Segment(Point(0, 0), Point(3, 4))");
+  EXPECT_EQ(Ray(Point(1, 1), Vector(0, -1)).ToString(),
+            "Ray(Point(1, 1), Vector(0, -1))");
+  EXPECT_EQ(Line(Point(0, 0), Point(1, 1)).ToString(), "Line(1, -1, 0)");
+  EXPECT_EQ(Circle(Point(5, 5), 2).ToString(), "Circle(Point(5, 5), 2)");
+  EXPECT_EQ(Polygon({Point(0, 0), Point(1, 0), Point(0, 1)}).ToString(),
+            "Polygon(Point(0, 0), Point(1, 0), Point(0, 1))");
+  EXPECT_EQ(Line(Point(-2147483647, 2147483647), Point(2147483647, 0))
+                .ToString(),
+            "Line(-2147483647, -4294967294, 4611686014132420609)");
+}
+
+TEST(TextTest, AppendToFailsOnShortBuffer) {
+  Polygon polygon({Point(-100, 2), Point(30, 40), Point(5, -600)});
+  std::string text = polygon.ToString();
+  std::vector<char> buffer(text.size());
+  for (size_t size = 0; size < text.size(); ++size) {
+    EXPECT_EQ(polygon.AppendTo(buffer.data(), buffer.data() + size), nullptr);
+  }
+  char* end = polygon.AppendTo(buffer.data(), buffer.data() + buffer.size());
+  EXPECT_EQ(std::string(buffer.data(), end), text);
+}
+
+TEST(TextTest, ParseRoundTrip) {
+  Generator generator(14);
+  std::vector<std::unique_ptr<IShape>> shapes;
+  for (int i = 0; i < 200; ++i) {
+    shapes.emplace_back(new Point(generator.MakePoint(2147483647)));
+    shapes.emplace_back(new Segment(generator.MakeSegment(2147483647)));
+    shapes.emplace_back(new Ray(generator.MakePoint(2147483647),
+                                Vector(generator.Coordinate(9),
+                                       generator.Coordinate(9))));
+    shapes.emplace_back(new Circle(generator.MakePoint(2147483647),
+                                   std::abs(generator.Coordinate(1 << 30))));
+    shapes.emplace_back(
+        new Polygon(generator.MakePolygon(1 + i % 20, 1 << 30, true)));
+  }
+
+  for (const auto& shape : shapes) {
+    std::string text = shape->ToString();
+    std::unique_ptr<IShape> parsed;
+    const char* end =
+        Geometry::Parse(text.data(), text.data() + text.size(), &parsed);
+    ASSERT_EQ(end, text.data() + text.size()) << text;
+    EXPECT_EQ(parsed->ToString(), text);
+  }
+}
+
+TEST(TextTest, ParseToleratesSpaces) {
+  const char* text = " Polygon( Point(1,2) ,Point( -3 , 4 ),\n Point(5, 6) ) ";
+  Polygon polygon;
+  EXPECT_NE(Geometry::Parse(text, text + std::strlen(text), &polygon),
+            nullptr);
+  EXPECT_EQ(polygon.ToString(),
+            "Polygon(Point(1, 2), Point(-3, 4), Point(5, 6))");
+}
+
+TEST(TextTest, ParseRejectsMalformed) {
+  for (const char* text :
+       {"", "Point(1, 2", "Point(2147483648, 0)", "Point(-2147483649, 0)",
+        "Point(-, 1)", "Point(1 2)", "Polygon(Point(1, 2),)", "Polygon(,)",
+        "Circle(Point(1, 2))", "Line(1, 2, 3)", "Square(Point(0, 0))"}) {
+    std::unique_ptr<IShape> shape;
+    EXPECT_EQ(Geometry::Parse(text, text + std::strlen(text), &shape),
+              nullptr)
+        << text;
+    EXPECT_EQ(shape, nullptr);
+  }
+
+  const char* limits = "Point(-2147483648, 2147483647)";
+  Point point;
+  EXPECT_NE(Geometry::Parse(limits, limits + std::strlen(limits), &point),
+            nullptr);
+  EXPECT_EQ(point.point, Vector(std::numeric_limits<int>::min(),
+                                std::numeric_limits<int>::max()));
+}
+
+TEST(CoordinateTypesTest, LongLongAndDouble) {
+  Generator generator(15);
+  for (int i = 0; i < 3000; ++i) {
+    Point a = generator.MakePoint(20);
+    Point b = generator.MakePoint(20);
+    Point p = generator.MakePoint(20);
+    Segment other = generator.MakeSegment(20);
+    auto borders = other.GetBorders();
+    bool crosses = Reference::SegmentsMeet(
+        ToReference(a), ToReference(b), ToReference(borders.first),
+        ToReference(borders.second));
+    bool contains =
+        Reference::OnSegment(ToReference(a), ToReference(b), ToReference(p));
+
+    const long long kScale = 1LL << 40;
+    auto wide = [&](const Point& point) {
+      return Geometry::BasicPoint<long long>(point.point.x * kScale,
+                                             point.point.y * kScale);
+    };
+    Geometry::BasicSegment<long long> wide_segment(wide(a), wide(b));
+    EXPECT_EQ(wide_segment.ContainsPoint(wide(p)), contains);
+    EXPECT_EQ(wide_segment.CrossesSegment(Geometry::BasicSegment<long long>(
+                  wide(borders.first), wide(borders.second))),
+              crosses);
+
+    auto real = [](const Point& point) {
+      return Geometry::BasicPoint<double>(point.point.x, point.point.y);
+    };
+    Geometry::BasicSegment<double> real_segment(real(a), real(b));
+    EXPECT_EQ(real_segment.ContainsPoint(real(p)), contains);
+    EXPECT_EQ(real_segment.CrossesSegment(Geometry::BasicSegment<double>(
+                  real(borders.first), real(borders.second))),
+              crosses);
+  }
+}
+
+// Scaling by 2^32 takes int shapes to the whole range of long long and
+// keeps every predicate, and multiplies squared distances by 2^64.
+TEST(CoordinateTypesTest, LongLongWholeRange) {
+  using WidePoint = Geometry::BasicPoint<long long>;
+  using WideSegment = Geometry::BasicSegment<long long>;
+  const long long kMin = std::numeric_limits<long long>::min();
+  const long long kMax = std::numeric_limits<long long>::max();
+  WideSegment diagonal(WidePoint(kMin, kMin), WidePoint(kMax, kMax));
+  EXPECT_TRUE(diagonal.ContainsPoint(WidePoint(0, 0)));
+  EXPECT_FALSE(diagonal.ContainsPoint(WidePoint(0, 1)));
+  Geometry::BasicCircle<long long> circle(WidePoint(kMin, kMin), kMax);
+  EXPECT_FALSE(circle.ContainsPoint(WidePoint(kMax, kMax)));
+  EXPECT_TRUE(circle.ContainsPoint(WidePoint(kMin, -1)));
+  EXPECT_FALSE(circle.CrossesSegment(WideSegment(WidePoint(kMax, kMin),
+                                                 WidePoint(kMin, kMax))));
+  EXPECT_EQ(Geometry::BasicLine<long long>(WidePoint(kMin, kMax),
+                                           WidePoint(kMax, kMin))
+                .ToString(),
+            "Line(-18446744073709551615, -18446744073709551615, "
+            "-18446744073709551615)");
+
+  const long long kScale = 1LL << 32;
+  auto wide = [&](const Point& point) {
+    return WidePoint(point.point.x * kScale, point.point.y * kScale);
+  };
+  Generator generator(16);
+  for (int limit : kLimits) {
+    for (int i = 0; i < 500; ++i) {
+      Point a = generator.MakePoint(limit);
+      Point b = generator.MakePoint(limit);
+      Vector direction(generator.Coordinate(limit),
+                       generator.Coordinate(limit));
+      int radius = std::abs(generator.Coordinate(limit));
+      Point p = generator.MakePoint(limit);
+      Segment other = generator.MakeSegment(limit);
+      auto borders = other.GetBorders();
+      WideSegment wide_other(wide(borders.first), wide(borders.second));
+
+      std::vector<std::unique_ptr<IShape>> shapes;
+      std::vector<std::unique_ptr<Geometry::BasicIShape<long long>>> wides;
+      shapes.emplace_back(new Segment(a, b));
+      wides.emplace_back(new WideSegment(wide(a), wide(b)));
+      shapes.emplace_back(new Ray(a, direction));
+      wides.emplace_back(new Geometry::BasicRay<long long>(
+          wide(a), Geometry::BasicVector<long long>(direction.x * kScale,
+                                                    direction.y * kScale)));
+      shapes.emplace_back(new Line(a, b));
+      wides.emplace_back(new Geometry::BasicLine<long long>(wide(a), wide(b)));
+      shapes.emplace_back(new Circle(a, radius));
+      wides.emplace_back(new Geometry::BasicCircle<long long>(
+          wide(a), radius * kScale));
+      std::vector<Point> vertexes = generator.MakePolygon(8, limit, true);
+      std::vector<WidePoint> wide_vertexes;
+      for (const Point& vertex : vertexes) {
+        wide_vertexes.push_back(wide(vertex));
+      }
+      shapes.emplace_back(new Polygon(vertexes));
+      wides.emplace_back(new Geometry::BasicPolygon<long long>(wide_vertexes));
+
+      for (size_t shape = 0; shape < shapes.size(); ++shape) {
+        EXPECT_EQ(wides[shape]->ContainsPoint(wide(p)),
+                  shapes[shape]->ContainsPoint(p));
+        EXPECT_EQ(wides[shape]->CrossesSegment(wide_other),
+                  shapes[shape]->CrossesSegment(other));
+        double distance = shapes[shape]->SquaredDistance(p).ToDouble();
+        EXPECT_NEAR(wides[shape]->SquaredDistance(wide(p)).ToDouble(),
+                    distance * 0x1p64, 0x1p65 + distance * 0x1p14);
+      }
+    }
+  }
+}
+
+}  // namespace